@@ -0,0 +1,49 @@
+#include "AuthorizationCache.h"
+
+AuthorizationCache::Lookup AuthorizationCache::lookup(simtime_t now)
+{
+    if (!enabled())
+        return DISABLED;
+
+    if (valid && now >= validUntil) {
+        valid = false;
+        expirations++;
+    }
+
+    if (valid) {
+        hits++;
+        if (maxUses > 0 && --usesLeft <= 0) {
+            valid = false;
+            exhaustions++;
+        }
+        return HIT;
+    }
+
+    if (pending) {
+        coalesced++;
+        return PENDING;
+    }
+
+    misses++;
+    pending = true;
+    return MISS;
+}
+
+void AuthorizationCache::store(simtime_t now, bool consumeUse)
+{
+    pending = false;
+    valid = true;
+    validUntil = now + ttl;
+    usesLeft = maxUses;
+
+    if (consumeUse && maxUses > 0 && --usesLeft <= 0) {
+        valid = false;
+        exhaustions++;
+    }
+}
+
+double AuthorizationCache::hitRate() const
+{
+    long queries = hits + misses + coalesced;
+    return queries > 0 ? (double)hits / queries : 0;
+}
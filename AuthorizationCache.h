@@ -0,0 +1,57 @@
+#ifndef __SMARTGARBAGECOLLECTION_AUTHORIZATIONCACHE_H_
+#define __SMARTGARBAGECOLLECTION_AUTHORIZATIONCACHE_H_
+
+#include <omnetpp.h>
+using namespace omnetpp;
+
+/**
+ * Can-side cache of the cloud's collect authorization (MSG_8/MSG_10 OK).
+ * An authorization is valid for a TTL and optionally a limited number of uses,
+ * a query while a request is in flight waits for that request instead of sending another.
+ */
+class AuthorizationCache
+{
+  public:
+    enum Lookup {DISABLED, HIT, MISS, PENDING};
+
+  protected:
+    simtime_t ttl;
+    int maxUses;             // 0 is unlimited
+
+    bool valid = false;
+    bool pending = false;
+    simtime_t validUntil;
+    int usesLeft = 0;
+
+  public:
+    // Statistics
+    long hits = 0;
+    long misses = 0;
+    long coalesced = 0;      // Queries answered by a request already in flight
+    long expirations = 0;    // Invalidated by the TTL
+    long exhaustions = 0;    // Invalidated by the use limit
+
+  public:
+    AuthorizationCache(simtime_t ttl = SIMTIME_ZERO, int maxUses = 0) : ttl(ttl), maxUses(maxUses) {}
+
+    // A zero TTL disables the cache, every query then goes to the cloud as before
+    bool enabled() const { return ttl > SIMTIME_ZERO; }
+
+    // Classifies a host query and consumes a use on a hit, a miss marks a request as in flight
+    Lookup lookup(simtime_t now);
+
+    // A request was sent without a host query, e.g. a refresh ahead of expiry
+    void requestSent() { pending = true; }
+
+    // The cloud's OK arrived, consumeUse if a host query was waiting for it
+    void store(simtime_t now, bool consumeUse);
+
+    // The request in flight was given up, the next query sends a new one
+    void requestLost() { pending = false; }
+
+    bool isValid(simtime_t now) const { return valid && now < validUntil; }
+    simtime_t getValidUntil() const { return validUntil; }
+    double hitRate() const;
+};
+
+#endif
@@ -0,0 +1,219 @@
+#include "CanField.h"
+#include "GarbageCollectionSystem.h"
+
+Define_Module(CanField);
+
+simsignal_t CanField::garbageCollectedSignal = cComponent::registerSignal("garbageCollectedFromField");
+
+void CanField::initialize(){
+    system = check_and_cast<GarbageCollectionSystem *>(getParentModule());
+
+    placeCans();
+
+    // Same fill state as the CanNode answers of the config, full unless NoGarbageInTheCans, or drawn per can
+    int numCans = getNumCans();
+    fill.assign(numCans, system->fsmType == GarbageCollectionSystem::EMPTY ? 0.0f : 1.0f);
+    fillRate.assign(numCans, 0);
+    fillSince.assign(numCans, 0);
+    for (int i = 0; i < numCans; i++) {
+        double initialFill = par("initialFill");
+        if (initialFill >= 0)
+            fill[i] = initialFill;
+        fillRate[i] = par("fillRate").doubleValue() / 3600;
+    }
+    collections.assign(numCans, 0);
+    dropCount.assign(numCans, 0);
+    collectPending.assign(numCans, 0);
+    queriesAnswered.assign(numCans, 0);
+
+    dropLimit = par("dropLimit");
+    if (dropLimit > 255)
+        throw cRuntimeError("dropLimit is kept in 8 bits per can, at most 255");
+    fullThreshold = par("fullThreshold");
+
+    if (system->canFieldOnRoute)
+        registerCans();
+
+    if (getEnvir()->isGUI())
+        render();
+
+    simtime_t reportInterval = par("reportInterval");
+    reportNoise = par("reportNoise");
+    if (reportInterval > SIMTIME_ZERO && numCans > 0) {
+        reportTick = reportInterval / numCans;
+        reportTimer = new cMessage("fillReport");
+        scheduleAt(simTime() + reportTick, reportTimer);
+    }
+}
+
+CanField::~CanField(){
+    cancelAndDelete(reportTimer);
+}
+
+double CanField::currentFill(int can) const {
+    return std::min(1.0, fill[can] + fillRate[can] * (SIMTIME_DBL(simTime()) - fillSince[can]));
+}
+
+// From the system's can layout, or numCans spread uniformly over the field
+void CanField::placeCans(){
+    int numCans = par("numCans");
+    if (numCans > 0) {
+        double width = par("fieldWidth"), height = par("fieldHeight");
+        canX.resize(numCans);
+        canY.resize(numCans);
+        for (int i = 0; i < numCans; i++) {
+            canX[i] = uniform(0, width);
+            canY[i] = uniform(0, height);
+        }
+        return;
+    }
+
+    const std::vector<RoadNetwork::CanSite>& sites = system->getCanSites();
+    if (sites.empty())
+        throw cRuntimeError("CanField needs numCans > 0 or a canLayoutFile");
+    canX.reserve(sites.size());
+    canY.reserve(sites.size());
+    for (const RoadNetwork::CanSite& site : sites) {
+        canX.push_back(site.x);
+        canY.push_back(site.y);
+    }
+}
+
+// Cans after the nodes in the position store, so the host's scans cover them
+void CanField::registerCans(){
+    PositionStore& positions = system->getPositions();
+    double canRange = par("canRange");
+    for (int i = 0; i < getNumCans(); i++) {
+        int index = positions.add(canX[i], canY[i], canRange, true);
+        if (i == 0)
+            firstSlot = positions.canSlotOf(index);
+    }
+}
+
+void CanField::handleMessage(cMessage *msg){
+    if (msg == reportTimer) {
+        sendFillReport(nextReport);
+        nextReport = (nextReport + 1) % getNumCans();
+        scheduleAt(simTime() + reportTick, reportTimer);
+        return;
+    }
+
+    system->traceReceive(this, msg);
+
+    int can = msg->hasPar("can") ? (int)(long)msg->par("can") : -1;
+    if (can < 0 || can >= getNumCans()) {
+        EV_WARN << "Can field got " << msg->getName() << " for unknown can " << can << "\n";
+        unknownCan++;
+        delete msg;
+        return;
+    }
+
+    switch (system->getMsgId(msg)) {
+        case MSG_1_IS_CAN_FULL: handleQuery(msg, can, MSG_2_NO, MSG_3_YES, MSG_7_COLLECT_GARBAGE); break;
+        case MSG_4_IS_CAN_FULL: handleQuery(msg, can, MSG_5_NO, MSG_6_YES, MSG_9_COLLECT_GARBAGE); break;
+        // Authorized collect request, or a visit of a collection round planned by the cloud
+        case MSG_8_OK:
+        case MSG_10_OK: handleCollectOk(can); break;
+    }
+
+    delete msg;
+}
+
+void CanField::handleQuery(cMessage *msg, int can, int noId, int yesId, int collectId){
+    queriesReceived++;
+
+    // Deterministic initial losses per can, like CanNode
+    if (dropCount[can] < dropLimit) {
+        dropCount[can]++;
+        queriesDropped++;
+        return;
+    }
+
+    bool full = currentFill(can) >= fullThreshold;
+    cMessage *resp = system->createReply(msg, (MsgID)(full ? yesId : noId));
+    system->traceSend(this, resp);
+    send(resp, "host$o", msg->getArrivalGate()->getIndex());
+    queriesAnswered[can]++;
+
+    // FAST, the can asks the cloud for the authorization itself, once per pending collection
+    if (full && system->fsmType == GarbageCollectionSystem::FAST && !collectPending[can]) {
+        cMessage *collect = system->createMessage((MsgID)collectId);
+        collect->addPar("can") = (long)can;
+        system->traceSend(this, collect);
+        send(collect, "cloud$o");
+        collectPending[can] = 1;
+        collectRequests++;
+    }
+}
+
+void CanField::handleCollectOk(int can){
+    // Time the can has been at 1, from its fill rate
+    double now = SIMTIME_DBL(simTime());
+    double level = currentFill(can);
+    collectedVolume += level;
+    if (level >= 1 && fillRate[can] > 0) {
+        overflowSeconds += now - (fillSince[can] + (1 - fill[can]) / fillRate[can]);
+        overflowedCollections++;
+    }
+
+    fill[can] = 0;
+    fillSince[can] = now;
+    collectPending[can] = 0;
+    collections[can]++;
+    collectionsDone++;
+    emit(garbageCollectedSignal, (long)can);
+}
+
+// Sensor reading with noise, clamped to the physical range
+void CanField::sendFillReport(int can){
+    double level = std::min(1.0, std::max(0.0, currentFill(can) + (reportNoise > 0 ? normal(0, reportNoise) : 0)));
+    cMessage *report = system->createMessage(MSG_16_FILL_REPORT);
+    report->addPar("can") = (long)can;
+    report->addPar("fill") = level;
+    system->traceSend(this, report);
+    send(report, "cloud$o");
+    reportsSent++;
+}
+
+// All cans as one path figure, the per can figures are what the field avoids
+void CanField::render(){
+    if (!system->getCanSites().empty())
+        return; // Already drawn with the road layout
+
+    cPathFigure *cans = new cPathFigure("fieldCans");
+    cans->setLineColor(cFigure::GREEN);
+    cans->setLineWidth(2);
+    for (int i = 0; i < getNumCans(); i++) {
+        cans->addMoveTo(canX[i] - 5, canY[i]);
+        cans->addLineTo(canX[i] + 5, canY[i]);
+        cans->addMoveTo(canX[i], canY[i] - 5);
+        cans->addLineTo(canX[i], canY[i] + 5);
+    }
+    system->canvas->addFigure(cans);
+}
+
+size_t CanField::stateBytes() const {
+    return canX.capacity() * sizeof(float) + canY.capacity() * sizeof(float) + fill.capacity() * sizeof(float)
+         + fillRate.capacity() * sizeof(float) + fillSince.capacity() * sizeof(double)
+         + collections.capacity() * sizeof(uint32_t) + dropCount.capacity() + collectPending.capacity()
+         + queriesAnswered.capacity() * sizeof(uint32_t);
+}
+
+void CanField::finish(){
+    recordScalar("numCans", getNumCans());
+    if (getNumCans() > 0)
+        recordScalar("stateBytesPerCan", (double)stateBytes() / getNumCans(), "B");
+    recordScalar("unknownCan", unknownCan);
+    recordScalar("collections", collectionsDone);
+    recordScalar("queriesReceived", queriesReceived);
+    recordScalar("queriesDropped", queriesDropped);
+    recordScalar("collectRequests", collectRequests);
+    if (reportTimer)
+        recordScalar("fillReportsSent", reportsSent);
+    if (collectionsDone > 0) {
+        recordScalar("collectedVolume", collectedVolume);
+        recordScalar("meanFillAtCollection", collectedVolume / collectionsDone);
+        recordScalar("overflowedCollections", overflowedCollections);
+        recordScalar("overflowHours", overflowSeconds / 3600);
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef __SMARTGARBAGECOLLECTION_CANFIELD_H_
+#define __SMARTGARBAGECOLLECTION_CANFIELD_H_
+
+#include <cstdint>
+#include <vector>
+#include <omnetpp.h>
+using namespace omnetpp;
+
+class GarbageCollectionSystem;
+
+/**
+ * Many cans in one module. The per-can state is kept as struct-of-arrays, without figures, gates or
+ * channels per can. Every message carries the can id as its "can" parameter. The cans answer the
+ * host's queries like CanNode, drops included, a full can asks the cloud for the collection in FAST
+ * configs, and an OK from the cloud empties its can. The cans also report their fill to the cloud.
+ * With canFieldOnRoute the cans are registered in the system's position store, so the host finds
+ * the cans at its stops with the same scans as the CanNode modules.
+ */
+class CanField : public cSimpleModule
+{
+  protected:
+    GarbageCollectionSystem *system = nullptr;
+
+    // Per can state, index is the can id
+    std::vector<float> canX, canY;
+    std::vector<float> fill;               // 0 empty .. 1 full, at fillSince
+    std::vector<float> fillRate;           // Fill per second, 0 keeps the fill constant
+    std::vector<double> fillSince;         // Seconds, last emptying or start. A float loses whole seconds after a few days
+    std::vector<uint32_t> collections;
+    std::vector<uint8_t> dropCount;        // Queries dropped so far, up to dropLimit
+    std::vector<uint8_t> collectPending;   // FAST collect request sent, waiting for the cloud's OK
+    std::vector<uint32_t> queriesAnswered;
+    int dropLimit = 0;
+    double fullThreshold = 1;
+    int firstSlot = -1;                    // Position store slot of can 0, -1 when the cans are not registered
+
+    // Fill reports to the cloud, one can per tick so every can reports once per reportInterval
+    cMessage *reportTimer = nullptr;
+    simtime_t reportTick;
+    double reportNoise = 0;
+    int nextReport = 0;
+
+    // Totals
+    long unknownCan = 0;
+    long queriesReceived = 0;
+    long queriesDropped = 0;
+    long collectRequests = 0;
+    long collectionsDone = 0;
+    long reportsSent = 0;
+    double collectedVolume = 0;            // Sum of the fill levels at the collections, in cans
+    double overflowSeconds = 0;            // Time cans spent full before their collection
+    long overflowedCollections = 0;
+
+  protected:
+    virtual void initialize() override;
+    virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
+
+    void placeCans();
+    void registerCans();
+    void handleQuery(cMessage *msg, int can, int noId, int yesId, int collectId);
+    void handleCollectOk(int can);
+    void sendFillReport(int can);
+    double currentFill(int can) const;
+    void render();
+
+  public:
+    static simsignal_t garbageCollectedSignal; // Id of the emptied can
+
+    virtual ~CanField();
+
+    int getNumCans() const { return canX.size(); }
+
+    // Can id of a position store slot is slot - getFirstSlot(), -1 before the field has initialized or without canFieldOnRoute
+    int getFirstSlot() const { return firstSlot; }
+
+    // Bytes of per can state
+    size_t stateBytes() const;
+};
+
+#endif
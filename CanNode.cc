@@ -5,121 +5,14 @@
  *      Author: joseph
  */
 
-#include "Node.h"
+#include "CanNodeBase.h"
 
-class CanNode : public Node {
+// First can of the route, queried with MSG_1 and authorized by the cloud with MSG_7 and MSG_8
+class CanNode : public CanNodeBase {
 
-protected:
-    // Drop vars
-    int dropCount = 0;
-    int dropLimit = 3;
-
-    // Statistic messages
-    int sendCanFast = 0;
-    int rcvdCanFast = 0;
-    int numberOfLostCanMsgs = 0;
-
-    enum GateIndex {GATE_HOST = 0, GATE_CLOUD = 1};
-
-    // Figure to render stats text
-    cTextFigure *statusText = nullptr;
-
-protected:
-    // Builting omnet overrides
-    virtual void initialize() override;
-    virtual void handleMessage(cMessage *msg) override;
-
-    bool shouldDropMessage();
-
-    void updateStatusText();
+public:
+    CanNode() : CanNodeBase({MSG_1_IS_CAN_FULL, MSG_2_NO, MSG_3_YES, MSG_7_COLLECT_GARBAGE, MSG_8_OK,
+                             Node::garbageCollectedSignalFromCan, &LinkDelays::connection_from_can_to_others, "Can"}) {}
 };
 
 Define_Module(CanNode);
-
-void CanNode::initialize(){
-    Node::initialize(); // Init baseline from Super
-
-    // ### SETUP STATUS TEXT ###
-    statusText = new cTextFigure("canStatus");
-    statusText->setColor(cFigure::BLUE);
-    statusText->setFont(cFigure::Font("Arial", 36));
-    updateStatusText();
-
-    statusText->setPosition(cFigure::Point(x - 500, y - 100)); // Above the node
-
-    system->canvas->addFigure(statusText);
-}
-
-void CanNode::handleMessage(cMessage *msg){
-
-    int msgId = system->getMsgId(msg);
-
-    switch(msgId){
-        // Triggered for fast config, emit signal that comm is done
-        case MSG_8_OK:
-        {
-            rcvdCanFast++;
-            updateStatusText();
-            emit(Node::garbageCollectedSignalFromCan, true);
-            break;
-        }
-        // Mesasge from host
-        case MSG_1_IS_CAN_FULL:
-        {
-            // Check if we should drop or process message
-            if(shouldDropMessage()) break;
-
-            // Create message based on config
-            cMessage *resp = system->fsmType == GarbageCollectionSystem::EMPTY ? system->createMessage(MSG_2_NO) : system->createMessage(MSG_3_YES);
-
-            // Calculate sending delay
-            simtime_t hostDelay = system->fastCellularLink->computeDynamicDelay(this, system->hostNode);
-            GlobalDelays.fast_others_to_smartphone += hostDelay.dbl();
-            GlobalDelays.connection_from_can_to_others += hostDelay.dbl();
-
-            // Send and update status texts
-            send(resp, "gate$o", GATE_HOST);
-            sendCanFast++;
-            rcvdCanFast++;
-            updateStatusText();
-
-            // Send message simultaneously to cloud if we have the fast config
-            if(system->fsmType == GarbageCollectionSystem::FAST){
-                // Send message and update local and global stats
-                cMessage *cloudMsg = system->createMessage(MSG_7_COLLECT_GARBAGE);
-                send(cloudMsg, "gate$o", GATE_CLOUD);
-                sendCanFast++;
-                updateStatusText();
-
-                simtime_t cloudDelay = system->fastWiFiLink->computeDynamicDelay(this, system->cloudNode);
-                GlobalDelays.fast_others_to_cloud += cloudDelay.dbl();
-                GlobalDelays.connection_from_can_to_others += cloudDelay.dbl();
-            }
-
-            break;
-        }
-    }
-
-    delete msg;
-}
-
-bool CanNode::shouldDropMessage(){
-    if (dropCount < dropLimit) {
-        bubble("Lost message");
-        dropCount++;
-        numberOfLostCanMsgs++;
-        updateStatusText();
-        return true;
-    }
-    return false;
-}
-
-// Util for text render
-void CanNode::updateStatusText() {
-    char buf[200];
-    sprintf(buf, "sentCanFast: %d rcvdCanFast: %d numberOfLostCanMsgs: %d",
-            sendCanFast, rcvdCanFast, numberOfLostCanMsgs);
-    if (statusText) {
-        statusText->setText(buf);
-    }
-}
@@ -0,0 +1,396 @@
+#include "CanNodeBase.h"
+#include "inet/mobility/base/MobilityBase.h"
+#include <cctype>
+#include <cmath>
+
+void CanNodeBase::initialize(){
+    Node::initialize(); // Init baseline from Super
+    dropLimit = par("dropLimit");
+    replyBackoff = par("replyBackoff");
+
+    // Beacons follow the host's position, periodic beacons go out whether or not someone hears them
+    beaconInterval = par("beaconInterval");
+    beaconRepeats = par("beaconRepeats");
+    beaconTimer = new cMessage("beaconTimer");
+    if (system->beaconMode == GarbageCollectionSystem::BEACON_PERIODIC)
+        scheduleAt(simTime() + beaconInterval, beaconTimer);
+
+    authorizations = AuthorizationCache(par("authorizationTtl"), par("authorizationUses"));
+    refreshAhead = par("refreshAuthorization");
+    refreshTimer = new cMessage("refreshTimer");
+    hitTimer = new cMessage("hitTimer");
+
+    // The host's position drives the beacons and ends the refreshes once it has passed the can
+    if (system->beaconMode != GarbageCollectionSystem::BEACON_NONE || refreshAhead)
+        system->hostNode->getSubmodule("mobility")->subscribe(inet::MobilityBase::mobilityStateChangedSignal, this);
+    if (authorizations.enabled() && par("prefetchAuthorization").boolValue())
+        scheduleAt(simTime(), refreshTimer); // The FSM type is known once the system has initialized
+
+    outbound = OutboundQueue(par("storeAndForwardBatch"));
+    uplinkTimeout = par("uplinkTimeout");
+    flushInterval = par("flushInterval");
+    uplinkTimer = new cMessage("uplinkTimer");
+    flushTimer = new cMessage("flushTimer");
+    retryTimer = new cMessage("retryTimer");
+    if (outbound.enabled() && system->gatewayNode)
+        throw cRuntimeError("storeAndForwardBatch needs the cans connected to the cloud, not to an edge gateway");
+
+    // ### SETUP STATUS TEXT ###
+    std::string figureName = std::string(1, std::tolower(protocol.label[0])) + (protocol.label + 1) + "Status";
+    statusText = new cTextFigure(figureName.c_str());
+    statusText->setColor(cFigure::BLUE);
+    statusText->setFont(cFigure::Font("Arial", 36));
+    updateStatusText();
+
+    statusText->setPosition(cFigure::Point(getX() - 500, getY() - 100)); // Above the node
+
+    system->canvas->addFigure(statusText);
+}
+
+CanNodeBase::~CanNodeBase(){
+    cancelAndDelete(beaconTimer);
+    cancelAndDelete(refreshTimer);
+    cancelAndDelete(hitTimer);
+    cancelAndDelete(uplinkTimer);
+    cancelAndDelete(flushTimer);
+    cancelAndDelete(retryTimer);
+}
+
+void CanNodeBase::handleMessage(cMessage *msg){
+    if (handleLinkEvent(msg)) return; // Transmit queue, telemetry
+
+    // Prefetch or refresh ahead of expiry, nobody waits for this OK
+    if (msg == refreshTimer) {
+        if (system->fsmType == GarbageCollectionSystem::FAST && !authorizations.isValid(simTime())) {
+            authorizations.requestSent();
+            sendCollectRequest();
+            refreshes++;
+        }
+        return;
+    }
+
+    if (msg == hitTimer) {
+        emit(protocol.collectedSignal, true);
+        return;
+    }
+
+    if (msg == uplinkTimer) {
+        uplinkTimedOut();
+        return;
+    }
+
+    if (msg == retryTimer) {
+        retryCollectRequest();
+        return;
+    }
+
+    // The batch in flight went unanswered, send it again
+    if (msg == flushTimer) {
+        outbound.batchLost();
+        flushOutbound();
+        return;
+    }
+
+    if (msg == beaconTimer) {
+        sendBeacon();
+        if (system->beaconMode == GarbageCollectionSystem::BEACON_PERIODIC && !hostPassed)
+            scheduleAt(simTime() + beaconInterval, beaconTimer);
+        else if (hostInCoverage && repeatsLeft-- > 0)
+            scheduleAt(simTime() + beaconInterval, beaconTimer);
+        return;
+    }
+
+    // Broadcast answer whose backoff has elapsed
+    if (msg->isSelfMessage() && system->getMsgId(msg) == MSG_13_DISCOVERY_REPLY) {
+        sendMessage(msg, GATE_MEDIUM);
+        return;
+    }
+
+    int msgId = system->getMsgId(msg);
+
+    // Triggered for fast config, emit signal that comm is done
+    if (msgId == protocol.ok) {
+        // Acknowledgement of a store-and-forward batch, the next batch follows right away. A late acknowledgement of a
+        // batch that was already given up and sent again in another batch does not count
+        if (msg->hasPar("batch")) {
+            if (outbound.batchAcked(simTime(), msg->par("batch").intValue())) {
+                cancelEvent(flushTimer);
+                flushOutbound();
+            }
+        }
+        else if (!okOutstanding) {
+            duplicateOks++;
+        }
+        else {
+            okOutstanding = false;
+            cancelEvent(uplinkTimer);
+            cancelEvent(retryTimer);
+            rcvdFast++;
+            updateStatusText();
+            collectRoundTrip.collect(system->getPathDelay(msg));
+            collectAuthorized();
+        }
+    }
+    // Message from host
+    else if (msgId == protocol.query) {
+        // Check if we should drop or process message
+        if (!shouldDropMessage()) {
+            // Create message based on config
+            cMessage *resp = system->createReply(msg, system->fsmType == GarbageCollectionSystem::EMPTY ? protocol.no : protocol.yes);
+
+            // Calculate sending delay
+            simtime_t hostDelay = system->fastCellularLink->computeDynamicDelay(this, system->hostNode);
+            GlobalDelays.fast_others_to_smartphone += hostDelay.dbl();
+            (GlobalDelays.*protocol.connectionDelay) += hostDelay.dbl();
+
+            // Send and update status texts
+            sendMessage(resp, GATE_HOST);
+            hostServed = true;
+            sentFast++;
+            rcvdFast++;
+            updateStatusText();
+
+            // Send message simultaneously to cloud if we have the fast config or a hybrid host chose the fog path, unless a cached authorization answers it
+            if (system->fsmType == GarbageCollectionSystem::FAST || msg->hasPar("viaFog"))
+                requestAuthorization();
+        }
+    }
+    // Broadcast from the host over the shared medium, answered there after a random backoff
+    else if (msgId == MSG_12_DISCOVER) {
+        if (!shouldDropMessage()) {
+            cMessage *resp = system->createReply(msg, MSG_13_DISCOVERY_REPLY);
+            resp->addPar("full") = system->fsmType != GarbageCollectionSystem::EMPTY;
+            scheduleAt(simTime() + uniform(0, replyBackoff), resp);
+            hostServed = true;
+            sentFast++;
+            rcvdFast++;
+            updateStatusText();
+
+            if (system->fsmType == GarbageCollectionSystem::FAST)
+                requestAuthorization();
+        }
+    }
+
+    delete msg;
+}
+
+bool CanNodeBase::shouldDropMessage(){
+    if (dropCount < dropLimit) {
+        bubble("Lost message");
+        dropCount++;
+        numberOfLostMsgs++;
+        updateStatusText();
+        return true;
+    }
+    return false;
+}
+
+void CanNodeBase::receiveSignal(cComponent *source, simsignal_t signalID, cObject *obj, cObject *details){
+    Enter_Method_Silent();
+
+    // Same coverage overlap rule as the host uses
+    auto pos = check_and_cast<inet::MobilityBase *>(source)->getCurrentPosition();
+    bool inCoverage = std::hypot(pos.x - getX(), pos.y - getY()) <= range + system->hostNode->par("range").doubleValue();
+
+    if (inCoverage && !hostInCoverage) {
+        hostInCoverage = true;
+        visitAuthorizationRequested = false;
+        if (system->beaconMode == GarbageCollectionSystem::BEACON_ENTRY) {
+            cancelEvent(beaconTimer);
+            repeatsLeft = beaconRepeats;
+            scheduleAt(simTime(), beaconTimer);
+        }
+    }
+    else if (!inCoverage && hostInCoverage) {
+        hostInCoverage = false;
+        if (system->beaconMode == GarbageCollectionSystem::BEACON_ENTRY)
+            cancelEvent(beaconTimer);
+        // Nobody comes back for this can, nothing keeps the run going after the route
+        if (hostServed && !hostPassed) {
+            hostPassed = true;
+            cancelEvent(refreshTimer);
+            if (system->beaconMode == GarbageCollectionSystem::BEACON_PERIODIC)
+                cancelEvent(beaconTimer);
+        }
+    }
+}
+
+// Pushes the fill state to the host, only delivered while the host is in coverage
+void CanNodeBase::sendBeacon(){
+    beaconsSent++;
+    if (!hostInCoverage) return;
+
+    bool full = system->fsmType != GarbageCollectionSystem::EMPTY;
+    cMessage *beacon = system->createMessage(MSG_14_BEACON);
+    beacon->addPar("full") = full;
+    beacon->setTimestamp();
+
+    simtime_t hostDelay = system->fastCellularLink->computeDynamicDelay(this, system->hostNode);
+    GlobalDelays.fast_others_to_smartphone += hostDelay.dbl();
+    (GlobalDelays.*protocol.connectionDelay) += hostDelay.dbl();
+    sendMessage(beacon, GATE_HOST);
+    hostServed = true;
+    sentFast++;
+    updateStatusText();
+
+    // The cloud is asked once per visit, like for the first answered query
+    if (full && system->fsmType == GarbageCollectionSystem::FAST && !visitAuthorizationRequested) {
+        visitAuthorizationRequested = true;
+        requestAuthorization();
+    }
+}
+
+// A cached authorization answers without the cloud, otherwise the collect request goes to the fog upstream
+void CanNodeBase::requestAuthorization(){
+    switch (authorizations.lookup(simTime())) {
+        case AuthorizationCache::HIT:
+            timeAtCanSaved.collect(collectRoundTrip.getCount() > 0 ? collectRoundTrip.getMean() : 0);
+            if (!hitTimer->isScheduled())
+                scheduleAt(simTime(), hitTimer);
+            break;
+        case AuthorizationCache::PENDING:
+            hostWaiting = true;
+            break;
+        case AuthorizationCache::MISS:
+            hostWaiting = true;
+            sendCollectRequest();
+            watchUplink();
+            break;
+        case AuthorizationCache::DISABLED:
+            sendCollectRequest();
+            watchUplink();
+            break;
+    }
+}
+
+// With store-and-forward, the host is released by the can if the cloud's OK does not come within uplinkTimeout.
+// Otherwise the request is sent again until the OK comes, the host waits for it
+void CanNodeBase::watchUplink(){
+    if (outbound.enabled()) {
+        if (!uplinkTimer->isScheduled())
+            scheduleAt(simTime() + uplinkTimeout, uplinkTimer);
+    }
+    else if (!retryTimer->isScheduled())
+        scheduleAt(simTime() + flushInterval, retryTimer);
+}
+
+void CanNodeBase::retryCollectRequest(){
+    if (!okOutstanding)
+        return;
+    collectRetries++;
+    sendCollectRequest();
+    scheduleAt(simTime() + flushInterval, retryTimer);
+}
+
+// The cloud did not answer in time, release the host now and queue the collect record for the cloud
+void CanNodeBase::uplinkTimedOut(){
+    localReleases++;
+    okOutstanding = false; // The record goes with a batch, a late OK of the request changes nothing
+    outbound.push(simTime());
+    if (authorizations.enabled()) {
+        authorizations.requestLost();
+        hostWaiting = false;
+    }
+    emit(protocol.collectedSignal, true);
+    if (!flushTimer->isScheduled())
+        scheduleAt(simTime() + flushInterval, flushTimer);
+}
+
+// Sends the next batch of queued records, the flush timer resends it until the cloud acknowledges it
+void CanNodeBase::flushOutbound(){
+    int records = outbound.nextBatch();
+    if (records == 0)
+        return;
+
+    cMessage *batch = system->createMessage(MSG_11_SUMMARY);
+    batch->addPar("records") = records;
+    batch->addPar("batch") = outbound.getBatchId();
+    sendMessage(batch, GATE_CLOUD);
+    sentFast++;
+    updateStatusText();
+    scheduleAt(simTime() + flushInterval, flushTimer);
+}
+
+void CanNodeBase::sendCollectRequest(){
+    // Send message and update local and global stats
+    cMessage *cloudMsg = system->createMessage(protocol.collect);
+    okOutstanding = true;
+
+    // Upstream is the edge gateway when the fog tier is enabled, the delay travels with the request
+    simtime_t cloudDelay = system->fastWiFiLink->computeDynamicDelay(this, system->fogUpstreamNode);
+    system->setPathDelay(cloudMsg, cloudDelay.dbl());
+    if (system->fogUpstreamNode == system->cloudNode)
+        GlobalDelays.fast_others_to_cloud += cloudDelay.dbl();
+    (GlobalDelays.*protocol.connectionDelay) += cloudDelay.dbl();
+    sendMessage(cloudMsg, GATE_CLOUD);
+    sentFast++;
+    updateStatusText();
+}
+
+// OK from the fog upstream, cache it and let a waiting host move on
+void CanNodeBase::collectAuthorized(){
+    if (!authorizations.enabled()) {
+        emit(protocol.collectedSignal, true);
+        return;
+    }
+
+    authorizations.store(simTime(), hostWaiting);
+    if (hostWaiting) {
+        hostWaiting = false;
+        emit(protocol.collectedSignal, true);
+    }
+    if (refreshAhead && !hostPassed && !refreshTimer->isScheduled())
+        scheduleAt(authorizations.getValidUntil(), refreshTimer);
+}
+
+void CanNodeBase::finish(){
+    if (collectRoundTrip.getCount() > 0)
+        collectRoundTrip.record();
+
+    recordScalar("messagesSent", sentFast);
+    if (collectRetries > 0 || duplicateOks > 0) {
+        recordScalar("collectRetries", collectRetries);
+        recordScalar("duplicateOks", duplicateOks);
+    }
+    if (system->beaconMode != GarbageCollectionSystem::BEACON_NONE)
+        recordScalar("beaconsSent", beaconsSent);
+
+    if (authorizations.enabled()) {
+        recordScalar("authorizationHits", authorizations.hits);
+        recordScalar("authorizationMisses", authorizations.misses);
+        recordScalar("authorizationCoalesced", authorizations.coalesced);
+        recordScalar("authorizationHitRate", authorizations.hitRate());
+        recordScalar("authorizationExpirations", authorizations.expirations);
+        recordScalar("authorizationExhaustions", authorizations.exhaustions);
+        recordScalar("authorizationRefreshes", refreshes);
+        recordScalar("timeAtCanSavedTotal", timeAtCanSaved.getSum(), "s");
+        if (timeAtCanSaved.getCount() > 0)
+            timeAtCanSaved.record();
+    }
+
+    // Records still pending at the end were never acknowledged, their stall is not in hostStallAvoided
+    if (outbound.enabled()) {
+        recordScalar("hostReleasesWithoutCloud", localReleases);
+        recordScalar("outboundRecordsQueued", outbound.recordsQueued);
+        recordScalar("outboundRecordsPending", (long)outbound.length());
+        recordScalar("outboundBatchesSent", outbound.batchesSent);
+        recordScalar("outboundBatchesLost", outbound.batchesLost);
+        recordScalar("outboundStaleAcks", outbound.staleAcks);
+        recordScalar("outboundMaxLength", (long)outbound.maxLength);
+        recordScalar("hostStallAvoidedTotal", outbound.stallAvoided.getSum(), "s");
+        if (outbound.stallAvoided.getCount() > 0)
+            outbound.stallAvoided.record();
+        if (outbound.flushBurst.getCount() > 0)
+            outbound.flushBurst.record();
+    }
+}
+
+// Util for text render
+void CanNodeBase::updateStatusText() {
+    char buf[200];
+    sprintf(buf, "sent%sFast: %d rcvd%sFast: %d numberOfLost%sMsgs: %d",
+            protocol.label, sentFast, protocol.label, rcvdFast, protocol.label, numberOfLostMsgs);
+    if (statusText) {
+        system->markTextDirty(statusText, buf);
+    }
+}
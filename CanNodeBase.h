@@ -0,0 +1,105 @@
+#ifndef __SMARTGARBAGECOLLECTION_CANNODEBASE_H_
+#define __SMARTGARBAGECOLLECTION_CANNODEBASE_H_
+
+#include "Node.h"
+#include "AuthorizationCache.h"
+#include "OutboundQueue.h"
+
+// What tells the cans of the route apart, their messages, their completion signal and their GlobalDelays entry
+struct CanProtocol {
+    MsgID query, no, yes;                // Host query and its answers
+    MsgID collect, ok;                   // Collect request to the fog upstream and its OK
+    simsignal_t collectedSignal;         // Lets the host move on in FAST configs
+    double LinkDelays::*connectionDelay; // Delays of the hops leaving this can
+    const char *label;                   // "Can" or "AnotherCan", for the status text
+};
+
+/**
+ * Smart can behaviour shared by CanNode and AnotherCanNode. Answers the host's queries and broadcasts, pushes fill
+ * state beacons, forwards collect requests to the fog upstream in FAST configs (or when a hybrid host chose the fog
+ * path), caches the upstream's authorizations and buffers collect records while the upstream does not answer.
+ */
+class CanNodeBase : public Node, public cListener {
+
+protected:
+    const CanProtocol protocol;
+
+    // Drop vars
+    int dropCount = 0;
+    int dropLimit = 3; // Overridden by the dropLimit parameter
+
+    // Statistic messages
+    int sentFast = 0;
+    int rcvdFast = 0;
+    int numberOfLostMsgs = 0;
+
+    enum GateIndex {GATE_HOST = 0, GATE_CLOUD = 1, GATE_MEDIUM = 2};
+
+    // Random delay before answering a broadcast, so the cans in coverage do not reply at the same time
+    simtime_t replyBackoff;
+
+    // Fill state beacons, sent on coverage entry of the host or periodically
+    cMessage *beaconTimer = nullptr;
+    simtime_t beaconInterval;
+    int beaconRepeats = 0;
+    int repeatsLeft = 0;
+    bool hostInCoverage = false;
+    bool hostServed = false;                  // The host got an answer or a beacon from this can
+    bool hostPassed = false;                  // And has left coverage since, refreshes and periodic beacons stop
+    bool visitAuthorizationRequested = false; // FAST, one collect request per host visit however many beacons go out
+    int beaconsSent = 0;
+
+    // Modeled round trip of the collect request to the fog upstream (cloud or gateway) and back
+    cStdDev collectRoundTrip{"collectRoundTrip"};
+
+    // Cached cloud authorization, a hit answers the host without a round trip to the fog upstream
+    AuthorizationCache authorizations;
+    bool refreshAhead = false;           // Request a new authorization when the cached one expires
+    bool hostWaiting = false;            // A host query waits for the OK of the request in flight
+    cMessage *refreshTimer = nullptr;
+    cMessage *hitTimer = nullptr;        // Releases the host on a hit, from its own event
+    int refreshes = 0;
+    cStdDev timeAtCanSaved{"timeAtCanSaved"}; // Mean collect round trip avoided per hit
+
+    // Store-and-forward, a collect request the cloud leaves unanswered releases the host and is delivered later
+    OutboundQueue outbound;
+    simtime_t uplinkTimeout;
+    simtime_t flushInterval;
+    cMessage *uplinkTimer = nullptr;
+    cMessage *flushTimer = nullptr;
+    int localReleases = 0;
+
+    // Without store-and-forward an unanswered collect request is sent again every flushInterval until its OK arrives
+    cMessage *retryTimer = nullptr;
+    bool okOutstanding = false;          // A collect request waits for its OK, later OKs of resent requests are duplicates
+    int collectRetries = 0;
+    int duplicateOks = 0;
+
+    // Figure to render stats text
+    cTextFigure *statusText = nullptr;
+
+protected:
+    // Builting omnet overrides
+    virtual void initialize() override;
+    virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
+    virtual void receiveSignal(cComponent *source, simsignal_t signalID, cObject *obj, cObject *details) override; // Host mobility, for the beacon modes
+
+    bool shouldDropMessage();
+    void sendCollectRequest();
+    void requestAuthorization();
+    void collectAuthorized();
+    void sendBeacon();
+    void watchUplink();
+    void retryCollectRequest();
+    void uplinkTimedOut();
+    void flushOutbound();
+
+    void updateStatusText();
+
+public:
+    explicit CanNodeBase(const CanProtocol& protocol) : protocol(protocol) {}
+    virtual ~CanNodeBase();
+};
+
+#endif
@@ -0,0 +1,205 @@
+#include "CellularCore.h"
+#include "GarbageCollectionSystem.h"
+#include <algorithm>
+
+Define_Module(CellularCore);
+
+CellularCore::~CellularCore(){
+    for (Direction *direction : {&up, &down}) {
+        for (auto& queue : direction->queues)
+            for (auto& queued : queue)
+                delete queued.msg;
+        delete direction->inService.msg;
+        cancelAndDelete(direction->txDone);
+    }
+    cancelAndDelete(virtualRequestTimer);
+}
+
+void CellularCore::initialize(){
+    system = check_and_cast<GarbageCollectionSystem *>(getParentModule());
+
+    capacity = par("capacity");
+    messageBytes = par("messageBytes");
+    quantum = par("quantum");
+    queueLimit = par("queueLimit");
+    numHostPorts = gateSize("host");
+    numVirtualHosts = par("numVirtualHosts");
+    virtualRequestInterval = par("virtualRequestInterval");
+    trafficRng = par("trafficRng");
+    if (quantum < messageBytes)
+        throw cRuntimeError("quantum must be at least messageBytes, otherwise a flow needs several turns per message");
+
+    int numFlows = numHostPorts + numVirtualHosts;
+    bytesDelivered.assign(numFlows, 0);
+    flowQueueingDelay.resize(numFlows);
+
+    up.name = "up";
+    down.name = "down";
+    for (Direction *direction : {&up, &down}) {
+        direction->queues.resize(numFlows);
+        direction->deficit.assign(numFlows, 0);
+        direction->txDone = new cMessage(direction == &up ? "uplinkTxDone" : "downlinkTxDone");
+        direction->queueingDelay.setName(direction == &up ? "uplinkQueueingDelay" : "downlinkQueueingDelay");
+    }
+
+    // The virtual hosts' requests are one Poisson process, each request belongs to a uniformly drawn virtual host
+    if (numVirtualHosts > 0) {
+        virtualRequestTimer = new cMessage("virtualRequest");
+        scheduleAt(simTime() + exponential(virtualRequestInterval / numVirtualHosts, trafficRng), virtualRequestTimer);
+    }
+}
+
+void CellularCore::handleMessage(cMessage *msg){
+    if (msg == up.txDone) {
+        transmissionDone(up);
+    }
+    else if (msg == down.txDone) {
+        transmissionDone(down);
+    }
+    else if (msg == virtualRequestTimer) {
+        int flow = numHostPorts + intuniform(0, numVirtualHosts - 1, trafficRng);
+        cMessage *request = new cMessage("virtualRequest");
+        request->setTimestamp();
+        enqueue(up, flow, request);
+        scheduleAt(simTime() + exponential(virtualRequestInterval / numVirtualHosts, trafficRng), virtualRequestTimer);
+    }
+    else if (msg->arrivedOn("cloud$i")) {
+        system->traceReceive(this, msg);
+        int flow = msg->hasPar("flow") ? (int)(long)msg->par("flow") : 0;
+        enqueue(down, std::min(std::max(flow, 0), numHostPorts - 1), msg);
+    }
+    else {
+        // From a host, tagged so the cloud's reply finds the flow again
+        system->traceReceive(this, msg);
+        int flow = msg->getArrivalGate()->getIndex();
+        msg->addPar("flow") = (long)flow;
+        enqueue(up, flow, msg);
+    }
+}
+
+void CellularCore::enqueue(Direction& direction, int flow, cMessage *msg){
+    std::deque<Queued>& queue = direction.queues[flow];
+    if ((int)queue.size() >= queueLimit) {
+        EV << "Core " << direction.name << "link queue of " << flowName(flow) << " full, dropping " << msg->getName() << "\n";
+        direction.drops++;
+        delete msg;
+        return;
+    }
+
+    queue.push_back({msg, simTime()});
+    if (queue.size() == 1 && flow != direction.serviceFlow)
+        direction.activeFlows.push_back(flow);
+
+    if (!direction.txDone->isScheduled())
+        startNext(direction);
+}
+
+// Deficit round robin, the front flow gets its quantum once per turn and keeps the server while its deficit covers the next message
+void CellularCore::startNext(Direction& direction){
+    while (!direction.activeFlows.empty()) {
+        int flow = direction.activeFlows.front();
+        if (!direction.turnStarted) {
+            direction.deficit[flow] += quantum;
+            direction.turnStarted = true;
+        }
+
+        if (messageBytes <= direction.deficit[flow]) {
+            direction.deficit[flow] -= messageBytes;
+            direction.inService = direction.queues[flow].front();
+            direction.queues[flow].pop_front();
+            direction.serviceFlow = flow;
+
+            simtime_t waited = simTime() - direction.inService.enqueued;
+            direction.queueingDelay.collect(waited);
+            flowQueueingDelay[flow].collect(waited);
+            direction.busyTime += serviceTime();
+            scheduleAt(simTime() + serviceTime(), direction.txDone);
+            return;
+        }
+
+        // Turn over, the unused deficit carries to the flow's next turn
+        direction.activeFlows.pop_front();
+        direction.activeFlows.push_back(flow);
+        direction.turnStarted = false;
+    }
+}
+
+void CellularCore::transmissionDone(Direction& direction){
+    int flow = direction.serviceFlow;
+    cMessage *msg = direction.inService.msg;
+    direction.inService.msg = nullptr;
+    direction.serviceFlow = -1;
+
+    // A flow that emptied its queue leaves the round and forfeits its deficit
+    if (direction.queues[flow].empty()) {
+        direction.activeFlows.pop_front();
+        direction.deficit[flow] = 0;
+        direction.turnStarted = false;
+    }
+
+    deliver(direction, flow, msg);
+    startNext(direction);
+}
+
+void CellularCore::deliver(Direction& direction, int flow, cMessage *msg){
+    bytesDelivered[flow] += messageBytes;
+
+    if (!isVirtual(flow)) {
+        system->traceSend(this, msg);
+        if (&direction == &up)
+            send(msg, "cloud$o");
+        else
+            send(msg, "host$o", flow);
+        return;
+    }
+
+    // The cloud's turnaround is not modeled for virtual hosts, their reply goes straight into the downlink
+    if (&direction == &up) {
+        cMessage *reply = new cMessage("virtualReply");
+        reply->setTimestamp(msg->getTimestamp());
+        delete msg;
+        enqueue(down, flow, reply);
+    }
+    else {
+        virtualRoundTrip.collect(simTime() - msg->getTimestamp());
+        delete msg;
+    }
+}
+
+std::string CellularCore::flowName(int flow) const {
+    if (isVirtual(flow))
+        return "virtualHost" + std::to_string(flow - numHostPorts);
+    return "host" + std::to_string(flow);
+}
+
+void CellularCore::finish(){
+    double duration = simTime().dbl();
+    double offeredBits = (double)numVirtualHosts / virtualRequestInterval.dbl() * messageBytes * 8;
+
+    recordScalar("virtualHosts", numVirtualHosts);
+    recordScalar("offeredUplinkLoad", offeredBits / capacity); // Virtual hosts only, > 1 is past the collapse point
+    for (Direction *direction : {&up, &down}) {
+        std::string prefix = std::string(direction->name) + "link";
+        recordScalar((prefix + "Drops").c_str(), direction->drops);
+        if (duration > 0)
+            recordScalar((prefix + "Utilization").c_str(), direction->busyTime.dbl() / duration);
+        direction->queueingDelay.record();
+    }
+    if (virtualRoundTrip.getCount() > 0)
+        virtualRoundTrip.record();
+
+    // Per flow throughput and mean queueing delay, and Jain's fairness index over the flows' throughput
+    double sum = 0, sumSquares = 0;
+    for (size_t flow = 0; flow < bytesDelivered.size(); flow++) {
+        double throughput = duration > 0 ? bytesDelivered[flow] * 8 / duration : 0;
+        sum += throughput;
+        sumSquares += throughput * throughput;
+
+        std::string name = flowName(flow);
+        recordScalar((name + ".throughput").c_str(), throughput, "bps");
+        if (flowQueueingDelay[flow].getCount() > 0)
+            recordScalar((name + ".queueingDelay").c_str(), flowQueueingDelay[flow].getMean(), "s");
+    }
+    if (sumSquares > 0)
+        recordScalar("throughputFairness", sum * sum / (bytesDelivered.size() * sumSquares));
+}
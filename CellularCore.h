@@ -0,0 +1,77 @@
+#ifndef __SMARTGARBAGECOLLECTION_CELLULARCORE_H_
+#define __SMARTGARBAGECOLLECTION_CELLULARCORE_H_
+
+#include <deque>
+#include <vector>
+#include <omnetpp.h>
+using namespace omnetpp;
+
+class GarbageCollectionSystem;
+
+/**
+ * Operator core between the hosts' slow cellular links and the cloud. Each direction is a single server of
+ * fixed aggregate capacity with one queue per flow, served by deficit round robin. Flows are the attached
+ * hosts plus optional virtual hosts, synthetic trucks that poll the cloud through the same core so the
+ * point where the cloud-based architecture collapses can be found without simulating their protocol.
+ */
+class CellularCore : public cSimpleModule
+{
+  protected:
+    struct Queued {
+        cMessage *msg;
+        simtime_t enqueued;
+    };
+
+    // One direction of the core
+    struct Direction {
+        const char *name;
+        std::vector<std::deque<Queued>> queues; // Per flow
+        std::vector<long> deficit;              // Bytes per flow, DRR
+        std::deque<int> activeFlows;            // Flows with queued messages, in service order
+        bool turnStarted = false;               // The front flow got its quantum for this turn
+        cMessage *txDone = nullptr;             // End of the transmission in service
+        Queued inService = {nullptr, 0};
+        int serviceFlow = -1;
+        simtime_t busyTime;
+        long drops = 0;
+        cHistogram queueingDelay;
+    };
+
+    GarbageCollectionSystem *system = nullptr;
+
+    double capacity;
+    long messageBytes;
+    long quantum;
+    int queueLimit;
+    int numHostPorts = 0;
+    int numVirtualHosts = 0;
+    simtime_t virtualRequestInterval;
+    int trafficRng = 0;
+
+    Direction up, down;
+    cMessage *virtualRequestTimer = nullptr;
+
+    // Per flow statistics, hosts first, then the virtual hosts
+    std::vector<long> bytesDelivered;
+    std::vector<cStdDev> flowQueueingDelay;  // Both directions
+    cHistogram virtualRoundTrip{"virtualRoundTrip"};
+
+  protected:
+    virtual void initialize() override;
+    virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
+
+    void enqueue(Direction& direction, int flow, cMessage *msg);
+    void startNext(Direction& direction);
+    void transmissionDone(Direction& direction);
+    void deliver(Direction& direction, int flow, cMessage *msg);
+
+    bool isVirtual(int flow) const { return flow >= numHostPorts; }
+    std::string flowName(int flow) const;
+    simtime_t serviceTime() const { return messageBytes * 8 / capacity; }
+
+  public:
+    virtual ~CellularCore();
+};
+
+#endif
@@ -6,6 +6,12 @@
  */
 
 #include "Node.h"
+#include "CloudServiceClient.h"
+#include "ConsistentHashRing.h"
+#include "FillForecaster.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 
 class CloudNode : public Node {
 
@@ -19,18 +25,90 @@ protected:
     // TExt for displaying stats
     cTextFigure *statusText = nullptr;
 
-    // Named gates
+    // Named gates, with an edge gateway GATE_CAN leads to the gateway and GATE_ANOTHER_CAN is not connected
     enum GateIndex { GATE_HOST = 0, GATE_CAN = 1, GATE_ANOTHER_CAN = 2 };
 
+    // Load seen by the cloud, compared between the direct and the gateway topology
+    long messagesReceived = 0;
+    long summaryRecordsReceived = 0;
+
+    // External cloud handler, nullptr when serviceAddress is empty. Collect requests are forwarded to it and the
+    // reply is held back for the wall clock time the handler took, so with the real-time scheduler it leaves on time
+    CloudServiceClient *service = nullptr;
+    std::map<cMessage *, int> heldReplies;    // Reply to gate index, waiting for their service time
+    cHistogram serviceLatency{"serviceWallLatency"};
+    cHistogram serviceRequestPathDelay{"serviceRequestPathDelay"}; // Modeled delay of the forwarded requests up to the cloud
+    long serviceFailures = 0;                 // Timeouts, lost connection or unexpected replies, answered by the model
+
+    // Sharded mode, nullptr without cloudShard modules. Collect requests wait here while the shard their can hashes
+    // to handles them, background jobs add the load of the rest of the city's cans
+    ConsistentHashRing *shardRing = nullptr;
+    struct ShardJob {
+        cMessage *request;    // nullptr for a background job
+        int shard;
+        simtime_t sentAt;
+    };
+    std::map<long, ShardJob> shardJobs;             // By job message id
+    std::vector<long> shardLoad;                    // Jobs sent to each shard
+    std::vector<cHistogram> shardLatency;           // Front end round trip per shard
+    std::vector<bool> shardEverActive;
+    std::map<std::string, int> keyOwner;            // Last shard of every key seen, to count the keys a rebalancing moves
+    std::vector<std::pair<simtime_t, int>> shardChanges; // Time and shard + 1, negative removes
+    size_t nextShardChange = 0;
+    cMessage *shardChangeTimer = nullptr;
+    cMessage *backgroundTimer = nullptr;
+    simtime_t backgroundInterval;
+    int backgroundCans = 0;
+    int backgroundRng = 0;
+    long movedKeys = 0;
+    long unshardedRequests = 0;                     // Answered by the front end while no shard was active
+
+    // Fill reports of the can field, and the collection rounds planned from them. Every planInterval the due cans
+    // are spread over numTrucks trucks, one visit per visitDuration each, soonest full first
+    FillForecaster *forecaster = nullptr;
+    std::string visitPolicy;
+    int fieldGate = -1;                             // Gate of the can field, -1 without one
+    simtime_t planInterval;
+    simtime_t visitDuration;
+    int numTrucks = 0;
+    std::deque<std::pair<simtime_t, long>> visits;  // Planned visit time and can, in time order
+    cMessage *planTimer = nullptr;
+    cMessage *visitTimer = nullptr;
+    long rounds = 0;
+    long visitsPlanned = 0;
+    long visitsMade = 0;
+    long visitsAvoided = 0;                         // Known cans a round left out as not due
+    long visitsDeferred = 0;                        // Due cans beyond the round's truck capacity
+
 protected:
     // Base omnet overrides
     virtual void initialize() override;
     virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
 
     // method for updating status text
     void updateStatusText();
 
-    void processCollectRequest(MsgID reqId, MsgID respId, Node* targetNode, int gateIndexFast);
+    void processCollectRequest(cMessage *req, MsgID respId, Node* targetNode);
+
+    // Asks the external handler about a collect request, returns its wall clock service time, 0 when the model answers
+    double callService(cMessage *req, Node *targetNode);
+    void sendReply(cMessage *resp, int gateIndex, double serviceSec);
+
+    // Sharded mode
+    void initializeShards();
+    std::string shardKey(cMessage *req);
+    void dispatchToShard(cMessage *req, const std::string& key);
+    void shardJobDone(cMessage *job);
+    void applyShardChange();
+    void recordShardStats();
+
+    // Collection rounds from the fill forecasts
+    void planRound();
+    void visitCan();
+
+public:
+    virtual ~CloudNode();
 };
 
 Define_Module(CloudNode);
@@ -46,44 +124,256 @@ void CloudNode::initialize(){
         statusText->setFont(cFigure::Font("Arial", 36));
         updateStatusText();
 
-        statusText->setPosition(cFigure::Point(x - 500, y - 130)); // Above the node
+        statusText->setPosition(cFigure::Point(getX() - 500, getY() - 130)); // Above the node
 
         system->canvas->addFigure(statusText);
     }
+
+    std::string serviceAddress = par("serviceAddress").stdstringValue();
+    if (!serviceAddress.empty())
+        service = new CloudServiceClient(serviceAddress, par("serviceTimeout").doubleValue());
+
+    if (gateSize("shard") > 0)
+        initializeShards();
+
+    // The field's OKs go back by its "can" parameter on the one field link
+    cModule *field = system->getSubmodule("field");
+    for (int i = 0; field && i < gateSize("gate"); i++) {
+        cGate *peer = gate("gate$o", i)->getPathEndGate();
+        if (peer && peer->getOwnerModule() == field)
+            fieldGate = i;
+    }
+
+    forecaster = new FillForecaster(par("forecastAlpha").doubleValue(), par("forecastHistory").intValue(),
+                                    par("fillThreshold").doubleValue());
+    visitPolicy = par("visitPolicy").stdstringValue();
+    if (visitPolicy != "none") {
+        planInterval = par("planInterval");
+        visitDuration = par("visitDuration");
+        numTrucks = par("numTrucks");
+        if (planInterval <= SIMTIME_ZERO || visitDuration <= SIMTIME_ZERO || numTrucks <= 0)
+            throw cRuntimeError("visitPolicy needs a positive planInterval, visitDuration and numTrucks");
+        planTimer = new cMessage("planRound");
+        visitTimer = new cMessage("visitCan");
+        scheduleAt(simTime() + planInterval, planTimer); // The first round has an interval of reports to go by
+    }
+}
+
+CloudNode::~CloudNode(){
+    for (auto& held : heldReplies)
+        cancelAndDelete(held.first);
+    delete service;
+    for (auto& job : shardJobs)
+        delete job.second.request;
+    cancelAndDelete(shardChangeTimer);
+    cancelAndDelete(backgroundTimer);
+    delete shardRing;
+    cancelAndDelete(planTimer);
+    cancelAndDelete(visitTimer);
+    delete forecaster;
+}
+
+// Ring of the initially active shards, the add and remove schedule, and the background load
+void CloudNode::initializeShards(){
+    int numShards = gateSize("shard");
+    int initialShards = par("initialShards");
+    if (initialShards < 0 || initialShards > numShards)
+        initialShards = numShards;
+
+    shardRing = new ConsistentHashRing(par("virtualNodesPerShard").intValue());
+    for (int shard = 0; shard < initialShards; shard++)
+        shardRing->addShard(shard);
+    shardLoad.assign(numShards, 0);
+    shardEverActive.assign(numShards, false);
+    for (int shard = 0; shard < initialShards; shard++)
+        shardEverActive[shard] = true;
+    shardLatency.resize(numShards);
+    for (int shard = 0; shard < numShards; shard++)
+        shardLatency[shard].setName(("shard" + std::to_string(shard) + "Latency").c_str());
+
+    // "<time>:+<shard>" adds, "<time>:-<shard>" removes
+    cStringTokenizer tokenizer(par("shardSchedule"));
+    while (tokenizer.hasMoreTokens()) {
+        std::string change = tokenizer.nextToken();
+        size_t colon = change.find(':');
+        int shard = colon == std::string::npos ? -1 : atoi(change.c_str() + colon + 2);
+        if (shard < 0 || shard >= numShards || (change[colon + 1] != '+' && change[colon + 1] != '-'))
+            throw cRuntimeError("Bad shardSchedule entry '%s', expected <time>:+<shard> or <time>:-<shard> with shard < %d", change.c_str(), numShards);
+        simtime_t at = SimTime::parse(change.substr(0, colon).c_str());
+        shardChanges.push_back({at, change[colon + 1] == '+' ? shard + 1 : -(shard + 1)});
+    }
+    std::stable_sort(shardChanges.begin(), shardChanges.end(),
+                     [](const std::pair<simtime_t, int>& a, const std::pair<simtime_t, int>& b) { return a.first < b.first; });
+    if (!shardChanges.empty()) {
+        shardChangeTimer = new cMessage("shardChange");
+        scheduleAt(shardChanges[0].first, shardChangeTimer);
+    }
+
+    backgroundInterval = par("backgroundCollectInterval");
+    backgroundCans = par("backgroundCans");
+    backgroundRng = par("backgroundRng");
+    if (backgroundInterval > SIMTIME_ZERO && backgroundCans > 0) {
+        backgroundTimer = new cMessage("backgroundCollect");
+        scheduleAt(simTime() + exponential(backgroundInterval, backgroundRng), backgroundTimer);
+    }
 }
 
 void CloudNode::handleMessage(cMessage *msg){
+    // Shard jobs are internal to the cloud and stay out of the link statistics
+    if (shardRing && msg->arrivedOn("shard$i")) {
+        system->traceReceive(this, msg);
+        shardJobDone(msg);
+        return;
+    }
+
+    if (handleLinkEvent(msg)) return; // Transmit queue, telemetry
+
+    if (msg == shardChangeTimer) {
+        applyShardChange();
+        return;
+    }
+
+    if (msg == planTimer) {
+        planRound();
+        return;
+    }
+
+    if (msg == visitTimer) {
+        visitCan();
+        return;
+    }
+
+    if (msg == backgroundTimer) {
+        dispatchToShard(nullptr, "background-" + std::to_string(intuniform(0, backgroundCans - 1, backgroundRng)));
+        scheduleAt(simTime() + exponential(backgroundInterval, backgroundRng), backgroundTimer);
+        return;
+    }
+
+    // A reply whose service time is over
+    auto held = heldReplies.find(msg);
+    if (held != heldReplies.end()) {
+        int gateIndex = held->second;
+        heldReplies.erase(held);
+        sendMessage(msg, gateIndex);
+        return;
+    }
 
     int msgId = system->getMsgId(msg);
+    messagesReceived++;
+
+    // Sharded, the request waits at the front end until the shard of its can has handled it
+    if (shardRing && (msgId == MSG_7_COLLECT_GARBAGE || msgId == MSG_9_COLLECT_GARBAGE)) {
+        dispatchToShard(msg, shardKey(msg));
+        return;
+    }
 
     switch (msgId) {
         case MSG_7_COLLECT_GARBAGE:
-            processCollectRequest(MSG_7_COLLECT_GARBAGE, MSG_8_OK, system->canNode, GATE_CAN);
+            processCollectRequest(msg, MSG_8_OK, system->canNode);
             break;
         case MSG_9_COLLECT_GARBAGE:
-            processCollectRequest(MSG_9_COLLECT_GARBAGE, MSG_10_OK, system->anotherCanNode, GATE_ANOTHER_CAN);
+            processCollectRequest(msg, MSG_10_OK, system->anotherCanNode);
+            break;
+        // Collect records the gateway already answered locally, nothing to reply. A can's store-and-forward batch is acknowledged with its id
+        case MSG_11_SUMMARY:
+            summaryRecordsReceived += msg->par("records").intValue();
+            if (msg->hasPar("batch")) {
+                int gateIndex = msg->getArrivalGate()->getIndex();
+                cMessage *ack = system->createReply(msg, gateIndex == GATE_CAN ? MSG_8_OK : MSG_10_OK);
+                ack->addPar("records") = msg->par("records").intValue();
+                ack->addPar("batch") = msg->par("batch").intValue();
+                sendMessage(ack, gateIndex);
+                sentCloudFast++;
+            }
+            rcvdCloudFast++;
+            updateStatusText();
+            break;
+        case MSG_16_FILL_REPORT:
+            forecaster->report((long)msg->par("can"), simTime(), msg->par("fill").doubleValue());
             break;
     }
 
     delete msg;
 }
 
-void CloudNode::processCollectRequest(MsgID reqId, MsgID respId, Node* targetNode, int gateIndexFast){
-    cMessage *resp = system->createMessage(respId);
+// "all" visits every can that has reported, "forecast" the ones expected past the threshold before the next round.
+// A can without a forecast yet is visited after the forecast ones, unknown is not the same as not full
+void CloudNode::planRound(){
+    rounds++;
+    std::vector<std::pair<double, long>> due; // Time to full and can
+    for (int row = 0; row < forecaster->getNumRows(); row++) {
+        if (!forecaster->hasForecast(row)) {
+            due.push_back({planInterval.dbl(), forecaster->getCan(row)});
+            continue;
+        }
+        double timeToFull = forecaster->timeToFull(row, simTime());
+        if (visitPolicy == "all" || timeToFull <= planInterval.dbl())
+            due.push_back({timeToFull, forecaster->getCan(row)});
+    }
+    visitsAvoided += forecaster->getNumRows() - due.size();
+
+    std::sort(due.begin(), due.end());
+    size_t capacity = (size_t)numTrucks * (size_t)std::floor(planInterval / visitDuration);
+    if (due.size() > capacity) {
+        visitsDeferred += due.size() - capacity;
+        due.resize(capacity);
+    }
+
+    // Visit i is truck i % numTrucks's (i / numTrucks)th stop, all done before the next round
+    for (size_t i = 0; i < due.size(); i++)
+        visits.push_back({simTime() + visitDuration * (double)(i / numTrucks), due[i].second});
+    visitsPlanned += due.size();
+
+    if (!visits.empty() && !visitTimer->isScheduled())
+        scheduleAt(visits.front().first, visitTimer);
+    scheduleAt(simTime() + planInterval, planTimer);
+}
 
-    switch(system->fsmType) {
+// Empties the can, the field sees it like the OK of a collect request
+void CloudNode::visitCan(){
+    while (!visits.empty() && visits.front().first <= simTime()) {
+        long can = visits.front().second;
+        visits.pop_front();
+        if (fieldGate >= 0) {
+            cMessage *ok = system->createMessage(MSG_8_OK);
+            ok->addPar("can") = can;
+            sendMessage(ok, fieldGate);
+        }
+        forecaster->emptied(can, simTime());
+        visitsMade++;
+    }
+    if (!visits.empty())
+        scheduleAt(visits.front().first, visitTimer);
+}
+
+void CloudNode::processCollectRequest(cMessage *req, MsgID respId, Node* targetNode){
+    cMessage *resp = system->createReply(req, respId);
+    double serviceSec = service ? callService(req, targetNode) : 0;
+
+    // Requests from the fog side are answered there, also in SLOW configs when a hybrid host left the request to the can
+    bool fromFog = req->getArrivalGate()->getIndex() != GATE_HOST;
+    switch(fromFog ? GarbageCollectionSystem::FAST : system->fsmType) {
         case GarbageCollectionSystem::FAST: {
-            send(resp, "gate$o", gateIndexFast);
+            // Reply the way the request came, directly to the can or through the edge gateway
+            int gateIndexFast = req->getArrivalGate()->getIndex();
+            bool viaGateway = system->gatewayNode != nullptr;
+
+            // A can of the field is not a Node, the field link adds no modeled delay
+            if (!req->hasPar("can")) {
+                simtime_t delay = viaGateway ? system->backhaulLink->computeDynamicDelay(this, system->gatewayNode)
+                                             : system->fastWiFiLink->computeDynamicDelay(this, targetNode);
+                system->setPathDelay(resp, system->getPathDelay(req) + delay.dbl());
+                GlobalDelays.fast_cloud_to_others += delay.dbl();
+                if (!viaGateway && targetNode == system->canNode)
+                    GlobalDelays.connection_from_others_to_can += delay.dbl();
+                else if (!viaGateway)
+                    GlobalDelays.connection_from_others_to_another_can += delay.dbl();
+            }
+
+            sendReply(resp, gateIndexFast, serviceSec);
             sentCloudFast++;
             rcvdCloudFast++;
             updateStatusText();
-
-            simtime_t delay = system->fastWiFiLink->computeDynamicDelay(this, targetNode);
-            GlobalDelays.fast_cloud_to_others += delay.dbl();
-            if (targetNode == system->canNode)
-                GlobalDelays.connection_from_others_to_can += delay.dbl();
-            else
-                GlobalDelays.connection_from_others_to_another_can += delay.dbl();
             break;
         }
         case GarbageCollectionSystem::SLOW:
@@ -98,19 +388,180 @@ void CloudNode::processCollectRequest(MsgID reqId, MsgID respId, Node* targetNod
                 GlobalDelays.slow_cloud_to_others += hostDelay.dbl();
             }
 
-            send(resp, "gate$o", GATE_HOST);
+            sendReply(resp, GATE_HOST, serviceSec);
+
+            // The host asked for a can of the field, the field empties it on its own copy of the OK
+            if (req->hasPar("can") && fieldGate >= 0)
+                sendReply(system->createReply(req, respId), fieldGate, serviceSec);
             break;
         }
     }
 }
 
+// One request line per collect, "COLLECT <can> <request id>", answered with "OK <request id>"
+double CloudNode::callService(cMessage *req, Node *targetNode){
+    std::string can = req->hasPar("can") ? "field-" + std::to_string((long)req->par("can")) : targetNode->getFullName();
+    std::string id = std::to_string(req->getTreeId());
+    std::string reply;
+
+    auto start = std::chrono::steady_clock::now();
+    bool ok = service->call("COLLECT " + can + " " + id, reply);
+    double serviceSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (!ok || reply != "OK " + id) {
+        EV_WARN << "Cloud service " << (ok ? "answered '" + reply + "'" : std::string("failed")) << ", the model answers " << req->getName() << "\n";
+        serviceFailures++;
+        return 0;
+    }
+
+    serviceLatency.collect(serviceSec);
+    serviceRequestPathDelay.collect(system->getPathDelay(req));
+    return serviceSec;
+}
+
+void CloudNode::sendReply(cMessage *resp, int gateIndex, double serviceSec){
+    if (serviceSec <= 0) {
+        sendMessage(resp, gateIndex);
+        return;
+    }
+    heldReplies[resp] = gateIndex;
+    scheduleAt(simTime() + serviceSec, resp);
+}
+
+// Requests about the same can always meet the same shard
+std::string CloudNode::shardKey(cMessage *req){
+    if (req->hasPar("can"))
+        return "field-" + std::to_string((long)req->par("can"));
+    return system->getMsgId(req) == MSG_7_COLLECT_GARBAGE ? system->canNode->getFullName() : system->anotherCanNode->getFullName();
+}
+
+void CloudNode::dispatchToShard(cMessage *req, const std::string& key){
+    int shard = shardRing->shardOf(key);
+    if (shard < 0) {
+        if (req) {
+            unshardedRequests++;
+            bool first = system->getMsgId(req) == MSG_7_COLLECT_GARBAGE;
+            processCollectRequest(req, first ? MSG_8_OK : MSG_10_OK, first ? system->canNode : system->anotherCanNode);
+            delete req;
+        }
+        return;
+    }
+
+    keyOwner[key] = shard;
+    shardLoad[shard]++;
+
+    cMessage *job = new cMessage(req ? "shardJob" : "backgroundJob");
+    shardJobs[job->getId()] = ShardJob{req, shard, simTime()};
+    system->traceSend(this, job);
+    send(job, "shard$o", shard);
+}
+
+void CloudNode::shardJobDone(cMessage *job){
+    auto it = shardJobs.find(job->getId());
+    ShardJob done = it->second;
+    shardJobs.erase(it);
+    delete job;
+
+    shardLatency[done.shard].collect(simTime() - done.sentAt);
+    if (done.request) {
+        bool first = system->getMsgId(done.request) == MSG_7_COLLECT_GARBAGE;
+        processCollectRequest(done.request, first ? MSG_8_OK : MSG_10_OK, first ? system->canNode : system->anotherCanNode);
+        delete done.request;
+    }
+}
+
+// Jobs already at a removed shard finish there, only new jobs follow the ring
+void CloudNode::applyShardChange(){
+    while (nextShardChange < shardChanges.size() && shardChanges[nextShardChange].first <= simTime()) {
+        int change = shardChanges[nextShardChange++].second;
+        int shard = std::abs(change) - 1;
+        if (change > 0) {
+            shardRing->addShard(shard);
+            shardEverActive[shard] = true;
+        }
+        else
+            shardRing->removeShard(shard);
+
+        long moved = 0;
+        for (auto& owner : keyOwner) {
+            int now = shardRing->shardOf(owner.first);
+            if (now != owner.second) {
+                owner.second = now;
+                moved++;
+            }
+        }
+        movedKeys += moved;
+        EV << (change > 0 ? "Added" : "Removed") << " cloud shard " << shard << ", " << moved << " of " << keyOwner.size() << " keys moved\n";
+        system->traceEvent(this, std::string(change > 0 ? "add shard " : "remove shard ") + std::to_string(shard));
+    }
+    if (nextShardChange < shardChanges.size())
+        scheduleAt(shardChanges[nextShardChange].first, shardChangeTimer);
+}
+
+// Load skew is the busiest shard's jobs over the mean of the shards that were ever active
+void CloudNode::recordShardStats(){
+    long total = 0, busiest = 0;
+    int active = 0;
+    for (size_t shard = 0; shard < shardLoad.size(); shard++) {
+        std::string name = "shard" + std::to_string(shard);
+        recordScalar((name + "Jobs").c_str(), shardLoad[shard]);
+        if (shardLatency[shard].getCount() > 0)
+            shardLatency[shard].record();
+        if (!shardEverActive[shard])
+            continue;
+        active++;
+        total += shardLoad[shard];
+        busiest = std::max(busiest, shardLoad[shard]);
+    }
+    if (total > 0)
+        recordScalar("shardLoadSkew", busiest / ((double)total / active));
+    recordScalar("shardMovedKeys", movedKeys);
+    recordScalar("shardKeys", (long)keyOwner.size());
+    recordScalar("unshardedRequests", unshardedRequests);
+}
+
+void CloudNode::finish(){
+    // Message rate over the whole run, to compare the flat topology with the gateway tier
+    recordScalar("messagesReceived", messagesReceived);
+    if (simTime() > 0)
+        recordScalar("messageRate", messagesReceived / simTime().dbl(), "1/s");
+    if (system->gatewayNode)
+        recordScalar("summaryRecordsReceived", summaryRecordsReceived);
+
+    if (shardRing)
+        recordShardStats();
+
+    if (forecaster->getNumRows() > 0) {
+        recordScalar("forecastRows", forecaster->getNumRows());
+        recordScalar("forecastStateBytesPerCan", (double)forecaster->stateBytes() / forecaster->getNumRows(), "B");
+        if (forecaster->forecastError.getCount() > 0)
+            forecaster->forecastError.record();
+    }
+    if (planTimer) {
+        recordScalar("rounds", rounds);
+        recordScalar("visitsPlanned", visitsPlanned);
+        recordScalar("visitsMade", visitsMade);
+        recordScalar("visitsAvoided", visitsAvoided);
+        recordScalar("visitsDeferred", visitsDeferred);
+        if (simTime() > 0)
+            recordScalar("visitsPerTruckHour", visitsMade / (numTrucks * simTime().dbl() / 3600));
+    }
+
+    // Wall clock service time of the external handler next to the modeled delays of the same requests
+    if (service) {
+        recordScalar("serviceFailures", serviceFailures);
+        serviceLatency.record();
+        serviceRequestPathDelay.record();
+    }
+}
+
 // Util for rendering text
 void CloudNode::updateStatusText() {
     char buf[200];
     sprintf(buf, "sentCloudFast: %d rcvdCloudFast: %d sentCloudSlow: %d rcvdCloudSlow: %d",
             sentCloudFast, rcvdCloudFast, sentCloudSlow, rcvdCloudSlow);
     if (statusText) {
-        statusText->setText(buf);
+        system->markTextDirty(statusText, buf);
     }
 }
 
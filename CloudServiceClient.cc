@@ -0,0 +1,101 @@
+#include "CloudServiceClient.h"
+#include <chrono>
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <netdb.h>
+#endif
+
+CloudServiceClient::CloudServiceClient(const std::string& address, double timeout) : timeout(timeout)
+{
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos)
+        throw cRuntimeError("Cloud service address '%s' is not host:port", address.c_str());
+    std::string host = address.substr(0, colon);
+    std::string port = address.substr(colon + 1);
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']')
+        host = host.substr(1, host.size() - 2);
+
+    // Names and IPv4 or IPv6 literals, the first address that accepts the connection is used
+    initsocketlibonce();
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *addresses = nullptr;
+    int error = getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses);
+    if (error != 0)
+        throw cRuntimeError("Cannot resolve the cloud service address '%s': %s", address.c_str(), gai_strerror(error));
+
+    for (addrinfo *ai = addresses; ai && sock == INVALID_SOCKET; ai = ai->ai_next) {
+        sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (sock != INVALID_SOCKET && connect(sock, ai->ai_addr, ai->ai_addrlen) == SOCKET_ERROR)
+            disconnect();
+    }
+    freeaddrinfo(addresses);
+    if (sock == INVALID_SOCKET)
+        throw cRuntimeError("Cannot connect to the cloud service at %s, is tools/cloud_standin.py running?", address.c_str());
+
+    // Requests are single short lines, don't let Nagle hold them back
+    int noDelay = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char *)&noDelay, sizeof(noDelay));
+}
+
+CloudServiceClient::~CloudServiceClient()
+{
+    disconnect();
+}
+
+void CloudServiceClient::disconnect()
+{
+    if (sock != INVALID_SOCKET)
+        closesocket(sock);
+    sock = INVALID_SOCKET;
+}
+
+bool CloudServiceClient::call(const std::string& request, std::string& reply)
+{
+    if (sock == INVALID_SOCKET)
+        return false;
+
+    std::string line = request + "\n";
+    if (send(sock, line.data(), line.size(), 0) != (int)line.size()) {
+        disconnect();
+        return false;
+    }
+
+    // Read until a full line is there, the timeout covers the whole call so every wait gets what is left of it
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(timeout);
+    size_t newline;
+    while ((newline = received.find('\n')) == std::string::npos) {
+        double remaining = std::chrono::duration<double>(deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0) {
+            disconnect();
+            return false;
+        }
+        fd_set readSet;
+        FD_ZERO(&readSet);
+        FD_SET(sock, &readSet);
+        timeval tv;
+        tv.tv_sec = (long)remaining;
+        tv.tv_usec = (long)((remaining - tv.tv_sec) * 1e6);
+        if (select(sock + 1, &readSet, nullptr, nullptr, &tv) <= 0) {
+            disconnect();
+            return false;
+        }
+
+        char buf[1024];
+        int n = recv(sock, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            disconnect();
+            return false;
+        }
+        received.append(buf, n);
+    }
+
+    reply = received.substr(0, newline);
+    received.erase(0, newline + 1);
+    if (!reply.empty() && reply.back() == '\r')
+        reply.pop_back();
+    return true;
+}
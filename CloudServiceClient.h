@@ -0,0 +1,34 @@
+#ifndef __SMARTGARBAGECOLLECTION_CLOUDSERVICECLIENT_H_
+#define __SMARTGARBAGECOLLECTION_CLOUDSERVICECLIENT_H_
+
+#include <string>
+#include <omnetpp.h>
+#include <omnetpp/platdep/sockets.h>
+using namespace omnetpp;
+
+/**
+ * Blocking line based TCP client for an external cloud handler on the local machine, see
+ * tools/cloud_standin.py for the protocol. Every call() sends one request line and waits for
+ * one reply line, at most timeout seconds.
+ */
+class CloudServiceClient
+{
+  protected:
+    SOCKET sock = INVALID_SOCKET;
+    double timeout;
+    std::string received;   // Bytes after the last complete reply line
+
+  public:
+    // "host:port", host a name or an IPv4 or IPv6 literal, the latter optionally in brackets.
+    // Throws cRuntimeError when the address does not resolve or the service is not reachable
+    CloudServiceClient(const std::string& address, double timeout);
+    ~CloudServiceClient();
+
+    // False on timeout or a closed connection, the client is then disconnected
+    bool call(const std::string& request, std::string& reply);
+
+    bool isConnected() const { return sock != INVALID_SOCKET; }
+    void disconnect();
+};
+
+#endif
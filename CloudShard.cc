@@ -0,0 +1,55 @@
+#include "CloudShard.h"
+#include "GarbageCollectionSystem.h"
+
+Define_Module(CloudShard);
+
+CloudShard::~CloudShard(){
+    for (cMessage *job : queue)
+        delete job;
+    delete inService;
+    cancelAndDelete(serviceDone);
+}
+
+void CloudShard::initialize(){
+    system = check_and_cast<GarbageCollectionSystem *>(getParentModule());
+    serviceDone = new cMessage("serviceDone");
+}
+
+void CloudShard::handleMessage(cMessage *msg){
+    system->traceReceive(this, msg);
+
+    if (msg == serviceDone) {
+        sojournTime.collect(simTime() - inService->getTimestamp());
+        jobsServed++;
+        system->traceSend(this, inService);
+        send(inService, "front$o");
+        inService = nullptr;
+        startService();
+        return;
+    }
+
+    msg->setTimestamp(); // Arrival at the shard
+    queue.push_back(msg);
+    maxQueueLength = std::max(maxQueueLength, queue.size());
+    if (!inService)
+        startService();
+}
+
+void CloudShard::startService(){
+    if (queue.empty())
+        return;
+    inService = queue.front();
+    queue.pop_front();
+    simtime_t service = par("serviceTime");
+    busyTime += service;
+    scheduleAt(simTime() + service, serviceDone);
+}
+
+void CloudShard::finish(){
+    recordScalar("jobsServed", jobsServed);
+    recordScalar("maxQueueLength", maxQueueLength);
+    if (simTime() > 0)
+        recordScalar("utilization", busyTime / simTime());
+    if (sojournTime.getCount() > 0)
+        sojournTime.record();
+}
@@ -0,0 +1,40 @@
+#ifndef __SMARTGARBAGECOLLECTION_CLOUDSHARD_H_
+#define __SMARTGARBAGECOLLECTION_CLOUDSHARD_H_
+
+#include <deque>
+#include <omnetpp.h>
+using namespace omnetpp;
+
+class GarbageCollectionSystem;
+
+/**
+ * One instance of the sharded cloud. Jobs from the cloud front end are served one at a time in arrival order,
+ * each for a serviceTime draw, and go back to the front end when done.
+ */
+class CloudShard : public cSimpleModule
+{
+  protected:
+    GarbageCollectionSystem *system = nullptr;
+
+    std::deque<cMessage *> queue;
+    cMessage *inService = nullptr;
+    cMessage *serviceDone = nullptr;
+
+    // Statistics
+    long jobsServed = 0;
+    size_t maxQueueLength = 0;
+    simtime_t busyTime;
+    cHistogram sojournTime{"sojournTime"};   // Arrival at the shard to departure
+
+  protected:
+    virtual void initialize() override;
+    virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
+
+    void startService();
+
+  public:
+    virtual ~CloudShard();
+};
+
+#endif
@@ -0,0 +1,42 @@
+#include "ConsistentHashRing.h"
+
+ConsistentHashRing::ConsistentHashRing(int virtualNodes) : virtualNodes(virtualNodes)
+{
+}
+
+uint64_t ConsistentHashRing::hash(const std::string& key){
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned char c : key) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+void ConsistentHashRing::addShard(int shard){
+    if (hasShard(shard))
+        return;
+    for (int v = 0; v < virtualNodes; v++)
+        ring[hash("shard-" + std::to_string(shard) + "#" + std::to_string(v))] = shard;
+    shards.insert(shard);
+}
+
+void ConsistentHashRing::removeShard(int shard){
+    if (!hasShard(shard))
+        return;
+    for (auto it = ring.begin(); it != ring.end();)
+        it = it->second == shard ? ring.erase(it) : std::next(it);
+    shards.erase(shard);
+}
+
+int ConsistentHashRing::shardOf(const std::string& key) const {
+    if (ring.empty())
+        return -1;
+    auto it = ring.lower_bound(hash(key));
+    return it == ring.end() ? ring.begin()->second : it->second;
+}
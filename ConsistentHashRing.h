@@ -0,0 +1,35 @@
+#ifndef __SMARTGARBAGECOLLECTION_CONSISTENTHASHRING_H_
+#define __SMARTGARBAGECOLLECTION_CONSISTENTHASHRING_H_
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+
+/**
+ * Consistent hash ring of shard indices. Every shard owns virtualNodes points on a 64 bit ring and a key belongs
+ * to the first point at or after its hash, so adding or removing a shard only moves the keys of that shard's points.
+ */
+class ConsistentHashRing
+{
+  protected:
+    int virtualNodes;
+    std::map<uint64_t, int> ring;   // Point to shard
+    std::set<int> shards;
+
+  public:
+    explicit ConsistentHashRing(int virtualNodes);
+
+    void addShard(int shard);
+    void removeShard(int shard);
+    bool hasShard(int shard) const { return shards.count(shard) > 0; }
+    int getNumShards() const { return shards.size(); }
+
+    // Shard of a key, -1 on an empty ring
+    int shardOf(const std::string& key) const;
+
+    // FNV-1a with a 64 bit finalizer, spreads short sequential keys such as can names over the ring
+    static uint64_t hash(const std::string& key);
+};
+
+#endif
@@ -0,0 +1,215 @@
+/*
+ * EdgeGatewayNode.cc
+ *
+ * Fog tier between a neighbourhood of cans and the cloud
+ */
+
+#include "Node.h"
+#include <deque>
+#include <map>
+
+class EdgeGatewayNode : public Node {
+
+protected:
+    // Answer collect requests at the gateway and only send summaries upstream, or forward every request to the cloud
+    bool answerLocally = true;
+    simtime_t summaryInterval;
+
+    // Sizes used for the backhaul byte count
+    int requestBytes = 0;
+    int summaryHeaderBytes = 0;
+    int summaryRecordBytes = 0;
+
+    // Gates 0..n-2 lead to cans, the last gate is the uplink to the cloud
+    int uplinkGate = 0;
+
+    // Collect records waiting for the next summary, the timer only runs while there are some
+    cMessage *summaryTimer = nullptr;
+    int pendingRecords = 0;
+
+    // Forwarded requests waiting for the cloud's reply, reply message id -> can gates in arrival order
+    std::map<int, std::deque<int>> pendingReplyGates;
+
+    // Statistics
+    int localAnswers = 0;
+    int forwardedRequests = 0;
+    int summariesSent = 0;
+    long backhaulBytes = 0;      // Bytes sent and received on the uplink
+    long directPathBytes = 0;    // Bytes the same requests would have put on a direct can-cloud link
+    cStdDev backhaulDelayAvoided{"backhaulDelayAvoided"}; // Modeled round trip to the cloud saved per local answer
+
+    cTextFigure *statusText = nullptr;
+
+protected:
+    virtual void initialize() override;
+    virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
+
+    void handleCollectRequest(cMessage *msg, MsgID respId);
+    void handleCloudReply(cMessage *msg);
+    void sendSummary();
+
+    void updateStatusText();
+
+public:
+    virtual ~EdgeGatewayNode();
+};
+
+Define_Module(EdgeGatewayNode);
+
+void EdgeGatewayNode::initialize(){
+    Node::initialize(); // Init baseline from super
+
+    answerLocally = par("answerLocally");
+    summaryInterval = par("summaryInterval");
+    requestBytes = par("requestBytes");
+    summaryHeaderBytes = par("summaryHeaderBytes");
+    summaryRecordBytes = par("summaryRecordBytes");
+    uplinkGate = gateSize("gate") - 1;
+
+    summaryTimer = new cMessage("summaryTimer");
+
+    // ### SETUP STATUS TEXT ###
+    statusText = new cTextFigure("gatewayStatus");
+    statusText->setColor(cFigure::BLUE);
+    statusText->setFont(cFigure::Font("Arial", 36));
+    updateStatusText();
+
+    statusText->setPosition(cFigure::Point(getX() - 500, getY() - 100)); // Above the node
+
+    system->canvas->addFigure(statusText);
+}
+
+EdgeGatewayNode::~EdgeGatewayNode(){
+    cancelAndDelete(summaryTimer);
+}
+
+void EdgeGatewayNode::handleMessage(cMessage *msg){
+    if (handleLinkEvent(msg)) return; // Transmit queue, telemetry
+
+    if (msg == summaryTimer) {
+        sendSummary();
+        return;
+    }
+
+    int msgId = system->getMsgId(msg);
+
+    switch(msgId){
+        // Requests from the cans
+        case MSG_7_COLLECT_GARBAGE: handleCollectRequest(msg, MSG_8_OK); break;
+        case MSG_9_COLLECT_GARBAGE: handleCollectRequest(msg, MSG_10_OK); break;
+        // Replies from the cloud to forwarded requests
+        case MSG_8_OK:
+        case MSG_10_OK: handleCloudReply(msg); break;
+    }
+
+    delete msg;
+}
+
+void EdgeGatewayNode::handleCollectRequest(cMessage *msg, MsgID respId){
+    int canGate = msg->getArrivalGate()->getIndex();
+    Node *can = check_and_cast<Node *>(gate("gate$o", canGate)->getPathEndGate()->getOwnerModule());
+    RealisticDelayChannel *canLink = check_and_cast<RealisticDelayChannel *>(gate("gate$o", canGate)->getChannel());
+
+    // A direct can-cloud link would have carried the request and the OK
+    directPathBytes += 2 * requestBytes;
+
+    if (answerLocally) {
+        // Authorize at the edge, the cloud learns about it with the next summary
+        cMessage *resp = system->createMessage(respId);
+        simtime_t delay = canLink->computeDynamicDelay(this, can);
+        system->setPathDelay(resp, system->getPathDelay(msg) + delay.dbl());
+        GlobalDelays.connection_from_others_to_can += can == system->canNode ? delay.dbl() : 0;
+        GlobalDelays.connection_from_others_to_another_can += can == system->anotherCanNode ? delay.dbl() : 0;
+        sendMessage(resp, canGate);
+
+        // What forwarding through the backhaul would have added
+        double up = system->backhaulLink->computeDynamicDelay(this, system->cloudNode).dbl();
+        double down = system->backhaulLink->computeDynamicDelay(system->cloudNode, this).dbl();
+        backhaulDelayAvoided.collect(up + down);
+
+        pendingRecords++;
+        localAnswers++;
+        if (!summaryTimer->isScheduled())
+            scheduleAt(simTime() + summaryInterval, summaryTimer);
+    }
+    else {
+        // Plain relay, the reply comes back through handleCloudReply()
+        cMessage *fwd = system->createMessage((MsgID)system->getMsgId(msg));
+        simtime_t delay = system->backhaulLink->computeDynamicDelay(this, system->cloudNode);
+        system->setPathDelay(fwd, system->getPathDelay(msg) + delay.dbl());
+        GlobalDelays.fast_others_to_cloud += delay.dbl();
+        sendMessage(fwd, uplinkGate);
+
+        pendingReplyGates[respId].push_back(canGate);
+        backhaulBytes += requestBytes;
+        forwardedRequests++;
+    }
+
+    updateStatusText();
+}
+
+void EdgeGatewayNode::handleCloudReply(cMessage *msg){
+    int msgId = system->getMsgId(msg);
+    std::deque<int>& waiting = pendingReplyGates[msgId];
+    if (waiting.empty()) {
+        EV_WARN << "Gateway got " << msg->getName() << " without a pending request\n";
+        return;
+    }
+    backhaulBytes += requestBytes;
+
+    int canGate = waiting.front();
+    waiting.pop_front();
+
+    Node *can = check_and_cast<Node *>(gate("gate$o", canGate)->getPathEndGate()->getOwnerModule());
+    RealisticDelayChannel *canLink = check_and_cast<RealisticDelayChannel *>(gate("gate$o", canGate)->getChannel());
+
+    // Same accounting as the locally answered OK, so the totals compare with the direct and local configs
+    cMessage *resp = system->createMessage((MsgID)msgId);
+    simtime_t delay = canLink->computeDynamicDelay(this, can);
+    system->setPathDelay(resp, system->getPathDelay(msg) + delay.dbl());
+    GlobalDelays.connection_from_others_to_can += can == system->canNode ? delay.dbl() : 0;
+    GlobalDelays.connection_from_others_to_another_can += can == system->anotherCanNode ? delay.dbl() : 0;
+    sendMessage(resp, canGate);
+}
+
+// One message upstream for all records answered since the last summary
+void EdgeGatewayNode::sendSummary(){
+    if (pendingRecords == 0) return;
+
+    cMessage *summary = system->createMessage(MSG_11_SUMMARY);
+    summary->addPar("records") = pendingRecords;
+
+    simtime_t delay = system->backhaulLink->computeDynamicDelay(this, system->cloudNode);
+    GlobalDelays.fast_others_to_cloud += delay.dbl();
+    sendMessage(summary, uplinkGate);
+
+    backhaulBytes += summaryHeaderBytes + pendingRecords * summaryRecordBytes;
+    summariesSent++;
+    pendingRecords = 0;
+    updateStatusText();
+}
+
+void EdgeGatewayNode::finish(){
+    // Records the run ended on before their summary, not in backhaulBytes
+    recordScalar("localAnswers", localAnswers);
+    recordScalar("pendingRecords", pendingRecords);
+    recordScalar("forwardedRequests", forwardedRequests);
+    recordScalar("summariesSent", summariesSent);
+    recordScalar("backhaulBytes", backhaulBytes, "B");
+    recordScalar("directPathBytes", directPathBytes, "B");
+    if (directPathBytes > 0)
+        recordScalar("backhaulByteReduction", 1 - (double)backhaulBytes / directPathBytes);
+    if (backhaulDelayAvoided.getCount() > 0)
+        backhaulDelayAvoided.record();
+}
+
+// Util for text rendering
+void EdgeGatewayNode::updateStatusText() {
+    char buf[200];
+    sprintf(buf, "localAnswers: %d forwarded: %d summaries: %d backhaulBytes: %ld",
+            localAnswers, forwardedRequests, summariesSent, backhaulBytes);
+    if (statusText) {
+        system->markTextDirty(statusText, buf);
+    }
+}
@@ -0,0 +1,111 @@
+#include "FillForecaster.h"
+#include <algorithm>
+#include <cmath>
+
+FillForecaster::FillForecaster(double alpha, int historyLength, double threshold)
+    : alpha(alpha), historyLength(historyLength), threshold(threshold)
+{
+}
+
+int FillForecaster::report(long can, simtime_t t, double fill)
+{
+    auto it = rowOf.find(can);
+    int row;
+    if (it == rowOf.end()) {
+        row = canId.size();
+        rowOf[can] = row;
+        canId.push_back(can);
+        lastTime.push_back(t);
+        lastFill.push_back(fill);
+        rate.push_back(0);
+        rateSamples.push_back(0);
+        reports.push_back(0);
+        cycleStart.push_back(0);
+        historySeconds.resize(historySeconds.size() + historyLength);
+        historyFill.resize(historyFill.size() + historyLength);
+    }
+    else {
+        row = it->second;
+        double dt = SIMTIME_DBL(t - lastTime[row]);
+        if (fill >= lastFill[row] - emptiedDrop && dt > 0) {
+            if (rateSamples[row] > 0)
+                forecastError.collect(fill - (lastFill[row] + rate[row] * dt));
+            double sample = (fill - lastFill[row]) / dt;
+            rate[row] = rateSamples[row]++ == 0 ? sample : rate[row] + alpha * (sample - rate[row]);
+        }
+        else if (fill < lastFill[row] - emptiedDrop)
+            cycleStart[row] = reports[row];
+        lastTime[row] = t;
+        lastFill[row] = fill;
+    }
+
+    size_t slot = (size_t)row * historyLength + reports[row] % historyLength;
+    historySeconds[slot] = (uint32_t)SIMTIME_DBL(t);
+    historyFill[slot] = (uint16_t)std::lround(std::min(std::max(fill, 0.0), 1.0) * 65535);
+    reports[row]++;
+    return row;
+}
+
+void FillForecaster::emptied(long can, simtime_t t)
+{
+    auto it = rowOf.find(can);
+    if (it == rowOf.end())
+        return;
+    lastTime[it->second] = t;
+    lastFill[it->second] = 0;
+    cycleStart[it->second] = reports[it->second];
+}
+
+double FillForecaster::timeToFull(int row, simtime_t now) const
+{
+    double r = forecastRate(row);
+    double projected = lastFill[row] + std::max(r, 0.0) * SIMTIME_DBL(now - lastTime[row]);
+    if (projected >= threshold)
+        return 0;
+    return r > 0 ? (threshold - projected) / r : INFINITY;
+}
+
+double FillForecaster::forecastRate(int row) const
+{
+    int size = historySize(row);
+    int n = std::min<uint32_t>(reports[row] - cycleStart[row], size);
+    if (n < minFitReports)
+        return rate[row];
+
+    // Seconds relative to the cycle's first report in the ring, they fit a double exactly
+    double t0 = 0, sumT = 0, sumF = 0, sumTT = 0, sumTF = 0;
+    for (int i = size - n; i < size; i++) {
+        double seconds, fill;
+        historyEntry(row, i, seconds, fill);
+        if (i == size - n)
+            t0 = seconds;
+        double t = seconds - t0;
+        sumT += t;
+        sumF += fill;
+        sumTT += t * t;
+        sumTF += t * fill;
+    }
+    double denominator = n * sumTT - sumT * sumT;
+    return denominator > 0 ? (n * sumTF - sumT * sumF) / denominator : rate[row];
+}
+
+int FillForecaster::historySize(int row) const
+{
+    return std::min<uint32_t>(reports[row], historyLength);
+}
+
+void FillForecaster::historyEntry(int row, int i, double& seconds, double& fill) const
+{
+    int oldest = reports[row] > (uint32_t)historyLength ? reports[row] % historyLength : 0;
+    size_t slot = (size_t)row * historyLength + (oldest + i) % historyLength;
+    seconds = historySeconds[slot];
+    fill = historyFill[slot] / 65535.0;
+}
+
+size_t FillForecaster::stateBytes() const
+{
+    return canId.capacity() * sizeof(long) + lastTime.capacity() * sizeof(simtime_t) + lastFill.capacity() * sizeof(float)
+         + rate.capacity() * sizeof(float) + rateSamples.capacity() * sizeof(uint32_t) + reports.capacity() * sizeof(uint32_t) + cycleStart.capacity() * sizeof(uint32_t)
+         + historySeconds.capacity() * sizeof(uint32_t) + historyFill.capacity() * sizeof(uint16_t)
+         + rowOf.size() * (sizeof(long) + sizeof(int) + 2 * sizeof(void *)); // Approximate node size of the index
+}
@@ -0,0 +1,73 @@
+#ifndef __SMARTGARBAGECOLLECTION_FILLFORECASTER_H_
+#define __SMARTGARBAGECOLLECTION_FILLFORECASTER_H_
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <omnetpp.h>
+using namespace omnetpp;
+
+/**
+ * Cloud-side store of the cans' fill reports. Every can gets a table row on its first report, found through a hash
+ * index by can id. A row keeps the last report, an EWMA of the fill rate between consecutive reports, and the last
+ * historyLength reports as a ring of 16 bit fill levels and 32 bit second offsets. A report costs one index lookup
+ * and a constant amount of work, the time-to-full forecast is computed from the row on demand: from a least-squares
+ * rate fit over the ring's reports of the current fill cycle once it has minFitReports of them, which evens out the
+ * sensor noise the EWMA of consecutive differences passes on, else from the EWMA.
+ */
+class FillForecaster
+{
+  protected:
+    double alpha;                  // Weight of a new rate sample
+    int historyLength;
+    double threshold;              // Fill level the forecast counts as full
+    double emptiedDrop = 0.05;     // A report this far below the last one means the can was emptied in between
+    int minFitReports = 3;
+
+    std::unordered_map<long, int> rowOf;
+
+    // Table rows, struct-of-arrays
+    std::vector<long> canId;
+    std::vector<simtime_t> lastTime;
+    std::vector<float> lastFill;
+    std::vector<float> rate;               // Fill per second
+    std::vector<uint32_t> rateSamples;
+    std::vector<uint32_t> reports;
+    std::vector<uint32_t> cycleStart;      // reports at the start of the current fill cycle
+
+    // Ring of the last reports per row, historyLength entries per row
+    std::vector<uint32_t> historySeconds;
+    std::vector<uint16_t> historyFill;
+
+  public:
+    cStdDev forecastError{"fillForecastError"};  // Reported fill minus the fill the row predicted for the report time
+
+  public:
+    explicit FillForecaster(double alpha = 0.3, int historyLength = 16, double threshold = 0.8);
+
+    // Adds a report, creating the row of a new can, and returns its row
+    int report(long can, simtime_t t, double fill);
+
+    // The can was emptied, the rate is kept for the next fill cycle
+    void emptied(long can, simtime_t t);
+
+    int getNumRows() const { return canId.size(); }
+    long getCan(int row) const { return canId[row]; }
+
+    // A rate needs two reports of the same fill cycle, rows without one have no forecast
+    bool hasForecast(int row) const { return rateSamples[row] > 0; }
+
+    // Seconds until the row's can passes the threshold, 0 if it already has, infinite without a positive rate
+    double timeToFull(int row, simtime_t now) const;
+
+    // Fill per second from the ring's reports of the current fill cycle, the EWMA rate with fewer than minFitReports
+    double forecastRate(int row) const;
+
+    // Oldest first, i < min(reports, historyLength)
+    int historySize(int row) const;
+    void historyEntry(int row, int i, double& seconds, double& fill) const;
+
+    size_t stateBytes() const;
+};
+
+#endif
@@ -8,40 +8,109 @@
 #include "GarbageCollectionSystem.h"
 #include "Node.h"
 #include "RealisticDelayChannel.h"
+#include "StudentT.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
 
 Define_Module(GarbageCollectionSystem);
 
 void GarbageCollectionSystem::initialize(){
 
+    // The totals are process wide, several runs in one process (sequential stopping, -r ranges) must not add up
+    GlobalDelays = LinkDelays();
+
     // Retrieve the system nodes
     canNode = check_and_cast<Node*>(getSubmodule("can"));
     anotherCanNode = check_and_cast<Node*>(getSubmodule("anotherCan"));
     cloudNode = check_and_cast<Node*>(getSubmodule("cloud"));
     hostNode = check_and_cast<Node*>(getSubmodule("host", 0));
 
+    // Optional fog tier between the cans and the cloud
+    if (par("useEdgeGateway").boolValue())
+        gatewayNode = check_and_cast<Node*>(getSubmodule("gateway"));
+    fogUpstreamNode = gatewayNode ? gatewayNode : cloudNode;
+
     // get the network canvas
     canvas = getCanvas();
 
+    // Figure updates are only worth coalescing when there is a GUI to draw them
+    hasGUI = getEnvir()->isGUI();
+    coalesceFigureUpdates = par("coalesceFigureUpdates");
+
+    // Optional road network, must be in place before the nodes initialize and read their positions
+    if (!par("roadNetworkFile").stdstringValue().empty())
+        loadRoadLayout();
+    placeNodes();
+
+    // Transmit queues of the nodes, only busy links queue so with the default 0B messages nothing waits
+    messageBytes = par("messageBytes");
+    std::string scheduling = par("linkScheduling").stdstringValue();
+    if (scheduling == "priority") linkScheduling = SCHEDULE_PRIORITY;
+    else if (scheduling == "wrr") linkScheduling = SCHEDULE_WRR;
+    else if (scheduling != "fifo") throw cRuntimeError("Unknown linkScheduling '%s', expected fifo, priority or wrr", scheduling.c_str());
+
+    cStringTokenizer weights(par("classWeights"));
+    for (int c = 0; c < NUM_TRAFFIC_CLASSES; c++) {
+        if (!weights.hasMoreTokens())
+            throw cRuntimeError("classWeights needs one weight per traffic class (control, signaling, bulk)");
+        classWeights[c] = atoi(weights.nextToken());
+        if (classWeights[c] <= 0)
+            throw cRuntimeError("classWeights must be positive");
+    }
+
+    static const char *classNames[NUM_TRAFFIC_CLASSES] = {"control", "signaling", "bulk"};
+    for (int c = 0; c < NUM_TRAFFIC_CLASSES; c++) {
+        classQueueingDelay[c].setName((std::string(classNames[c]) + "QueueingDelay").c_str());
+        classLatency[c].setName((std::string(classNames[c]) + "Latency").c_str());
+    }
+
+    // Optional trace export, one track per node
+    std::string traceFile = par("traceFile").stdstringValue();
+    if (!traceFile.empty()) {
+        trace = new TraceWriter(traceFile, par("traceBufferSize").intValue());
+        if (!trace->isOpen())
+            throw cRuntimeError("Cannot open traceFile '%s'", traceFile.c_str());
+        trace->processName(getId(), getFullName());
+        for (cModule::SubmoduleIterator it(this); !it.end(); ++it)
+            trace->threadName(getId(), (*it)->getId(), (*it)->getFullName());
+    }
+
+    // Optional shared medium between the host and the cans
+    broadcastDiscovery = par("useBroadcastDiscovery");
+
+    std::string beacons = par("canBeacons").stdstringValue();
+    if (beacons == "entry") beaconMode = BEACON_ENTRY;
+    else if (beacons == "periodic") beaconMode = BEACON_PERIODIC;
+    else if (beacons != "none") throw cRuntimeError("Unknown canBeacons mode '%s', expected none, entry or periodic", beacons.c_str());
+
+    // The field answers unicast queries only
+    canFieldOnRoute = par("canFieldOnRoute");
+    if (canFieldOnRoute && (!par("useCanField").boolValue() || broadcastDiscovery || beaconMode != BEACON_NONE))
+        throw cRuntimeError("canFieldOnRoute needs useCanField, without broadcast discovery and can beacons");
+
     // retrieve the config name
     configName = getEnvir()->getConfigEx()->getActiveConfigName();
 
     // ### SETUP APPROPRIATE FSM CONFIG ###
-    // Assign fsdType, and initial state to go to
-    if(strcmp(configName, "GarbageInTheCansAndSlow") == 0){
+    // Assign fsdType, and initial state to go to, configs that extend one of the three base configs use its FSM
+    if(activeConfigExtends("GarbageInTheCansAndSlow")){
         fsmType = SLOW;
         currentFsm = &slowFsm;
         currentFsm->setName("slow");
         FSM_Goto(*currentFsm, SLOW_SEND_TO_CAN);
     }
 
-    if(strcmp(configName, "GarbageInTheCansAndFast") == 0){
+    if(activeConfigExtends("GarbageInTheCansAndFast")){
         fsmType = FAST;
         currentFsm = &fastFsm;
         currentFsm->setName("fast");
         FSM_Goto(*currentFsm, FAST_SEND_TO_CAN);
     }
 
-    if(strcmp(configName, "NoGarbageInTheCans") == 0){
+    if(activeConfigExtends("NoGarbageInTheCans")){
         fsmType = EMPTY;
         currentFsm = &emptyFsm;
         currentFsm->setName("empty");
@@ -61,11 +130,399 @@ void GarbageCollectionSystem::initialize(){
         slowCellularLink = check_and_cast<RealisticDelayChannel *>(
             hostNode->gate("gate$o", 2)->getChannel());
 
+    // The gateway's last gate is its uplink to the cloud
+    if (gatewayNode)
+        backhaulLink = check_and_cast<RealisticDelayChannel *>(
+            gatewayNode->gate("gate$o", gatewayNode->gateSize("gate") - 1)->getChannel());
+
     renderInitialDelayStats(); // Empty stats
+
+    // Analytic estimate of the latency distributions, optionally without running the event simulation at all
+    analyticEstimate = par("analyticEstimate");
+    if (analyticEstimate) {
+        runAnalyticEstimate();
+        if (par("analyticOnly").boolValue())
+            stopAtStart();
+    }
+
+    // Setup benchmark, the timer is the first event after initialization and ends the run
+    if (par("setupBenchmark").boolValue()) {
+        setupDoneTimer = new cMessage("setupDone");
+        setupDoneTimer->setSchedulingPriority(-1);
+        scheduleAt(simTime(), setupDoneTimer);
+    }
+
+    // Timer wheel, the host timers register with it from their own initialize()
+    timerWheelTick = par("timerWheelTick");
+    if (timerWheelTick > SIMTIME_ZERO) {
+        timerWheel = new TimerWheel(par("timerWheelSlotBits").intValue(), par("timerWheelLevels").intValue());
+        wheelTickTimer = new cMessage("wheelTick");
+    }
+
+    // Position benchmark, from its own event after the setup benchmark's so its scans do not count as setup time
+    if (par("positionBenchmarkRounds").intValue() > 0) {
+        positionBenchmarkTimer = new cMessage("positionBenchmark");
+        positionBenchmarkTimer->setSchedulingPriority(-1);
+        scheduleAt(simTime(), positionBenchmarkTimer);
+    }
+
+    // Sequential stopping, the controller may decide from earlier replications that this one is not needed
+    const char *stateFile = par("sequentialStateFile");
+    if (*stateFile != '\0') {
+        sequentialStopping = new SequentialStopping(stateFile, par("sequentialRelativePrecision").doubleValue(),
+                                                    par("sequentialCpuBudget").doubleValue(), par("sequentialMinReplications").intValue());
+
+        // The first replication starts a new sequence
+        if (getEnvir()->getConfigEx()->getActiveRunNumber() == 0)
+            sequentialStopping->reset();
+        else
+            sequentialStopping->load();
+
+        if (sequentialStopping->shouldStop()) {
+            EV << "Sequential stopping: target met after " << sequentialStopping->getNumReplications() << " replications, skipping this one\n";
+            skipReplication = true;
+            stopAtStart();
+        }
+        else {
+            fastCellularLink->setSampleDelays(true);
+            fastWiFiLink->setSampleDelays(true);
+            slowCellularLink->setSampleDelays(true);
+        }
+        cpuStart = std::clock();
+    }
+}
+
+GarbageCollectionSystem::~GarbageCollectionSystem(){
+    delete sequentialStopping;
+    delete trace;
+    delete roadNetwork;
+    cancelAndDelete(setupDoneTimer);
+    cancelAndDelete(positionBenchmarkTimer);
+    cancelAndDelete(wheelTickTimer);
+    delete timerWheel;
+}
+
+// Snaps the cans and the host's start to the roads and routes the three legs start -> can -> anotherCan -> start
+void GarbageCollectionSystem::loadRoadLayout(){
+    roadNetwork = new RoadNetwork();
+    roadNetwork->load(par("roadNetworkFile").stdstringValue(), par("roadGridCellSize").doubleValue());
+
+    std::string layoutFile = par("canLayoutFile").stdstringValue();
+    if (!layoutFile.empty())
+        canSites = roadNetwork->loadCanSites(layoutFile);
+
+    // Without a layout file the cans keep their NED positions and are only snapped
+    auto siteOf = [&](cModule *can, const char *idPar, size_t defaultRow) {
+        std::string id = par(idPar).stdstringValue();
+        if (canSites.empty()) {
+            RoadNetwork::CanSite site;
+            site.id = can->getFullName();
+            site.x = can->par("x");
+            site.y = can->par("y");
+            site.road = roadNetwork->snap(site.x, site.y);
+            return site;
+        }
+        for (const RoadNetwork::CanSite& site : canSites)
+            if (id.empty() ? &site == &canSites[std::min(defaultRow, canSites.size() - 1)] : site.id == id)
+                return site;
+        throw cRuntimeError("No can with id '%s' in '%s'", id.c_str(), layoutFile.c_str());
+    };
+
+    RoadNetwork::CanSite canSite = siteOf(canNode, "canSiteId", 0);
+    RoadNetwork::CanSite anotherCanSite = siteOf(anotherCanNode, "anotherCanSiteId", 1);
+    RoadNetwork::SnapPoint start = roadNetwork->snap(hostNode->par("x"), hostNode->par("y"));
+
+    // The host stops at the snapped waypoint, out of coverage it would never complete the visit
+    auto checkCoverage = [&](cModule *can, const RoadNetwork::CanSite& site) {
+        double coverage = can->par("range").doubleValue() + hostNode->par("range").doubleValue();
+        if (site.road.distance > coverage)
+            throw cRuntimeError("Can '%s' snaps to a road %.0fm away, outside the %.0fm coverage of %s and the host",
+                                site.id.c_str(), site.road.distance, coverage, can->getFullName());
+    };
+    checkCoverage(canNode, canSite);
+    checkCoverage(anotherCanNode, anotherCanSite);
+
+    layoutPositions[canNode] = cFigure::Point(canSite.x, canSite.y);
+    layoutPositions[anotherCanNode] = cFigure::Point(anotherCanSite.x, anotherCanSite.y);
+    layoutPositions[hostNode] = cFigure::Point(start.x, start.y);
+    layoutWaypoints[canNode] = Coord(canSite.road.x, canSite.road.y);
+    layoutWaypoints[anotherCanNode] = Coord(anotherCanSite.road.x, anotherCanSite.road.y);
+
+    std::string xml = "<movements>\n";
+    xml += routeLeg("1", roadNetwork->route(start, canSite.road), true);
+    xml += routeLeg("2", roadNetwork->route(canSite.road, anotherCanSite.road), false);
+    xml += routeLeg("3", roadNetwork->route(anotherCanSite.road, start), false);
+    xml += "</movements>\n";
+    roadRoute = getEnvir()->getParsedXMLString(xml.c_str());
+
+    cStdDev snapDistance("canSnapDistance");
+    for (const RoadNetwork::CanSite& site : canSites)
+        snapDistance.collect(site.road.distance);
+    recordScalar("roadNodes", roadNetwork->getNumNodes());
+    recordScalar("roadSegments", roadNetwork->getNumSegments());
+    recordScalar("roadGridCellSize", roadNetwork->getCellSize(), "m");
+    recordScalar("cansLoaded", (double)canSites.size());
+    if (snapDistance.getCount() > 0)
+        snapDistance.record();
+
+    if (hasGUI)
+        renderRoadLayout(canSites);
+}
+
+// One turtle movement, the first leg also places the host
+std::string GarbageCollectionSystem::routeLeg(const char *id, const std::vector<RoadNetwork::RoutePoint>& points, bool first){
+    std::ostringstream leg;
+    leg << "<movement id=\"" << id << "\">\n";
+    if (first)
+        leg << "<set x=\"" << points[0].x << "\" y=\"" << points[0].y << "\" z=\"0\" borderPolicy=\"reflect\"/>\n";
+
+    double speed = -1;
+    for (size_t i = 1; i < points.size(); i++) {
+        if (std::hypot(points[i].x - points[i - 1].x, points[i].y - points[i - 1].y) < 1e-6)
+            continue;
+        if (points[i].speed != speed) {
+            speed = points[i].speed;
+            leg << "<set speed=\"" << speed << "\"/>\n";
+        }
+        leg << "<moveto x=\"" << points[i].x << "\" y=\"" << points[i].y << "\"/>\n";
+    }
+    leg << "</movement>\n";
+    return leg.str();
+}
+
+// The loaded roads replace the drawn ones, all roads and all cans are one path figure each
+void GarbageCollectionSystem::renderRoadLayout(const std::vector<RoadNetwork::CanSite>& sites){
+    for (const char *name : {"outerroad", "innerroad"})
+        if (cFigure *road = canvas->getFigure(name))
+            road->setVisible(false);
+
+    cPathFigure *roads = new cPathFigure("roads");
+    roads->setLineColor(cFigure::BLACK);
+    roads->setLineWidth(4);
+    for (int s = 0; s < roadNetwork->getNumSegments(); s++) {
+        double x1, y1, x2, y2;
+        roadNetwork->getSegment(s, x1, y1, x2, y2);
+        roads->addMoveTo(x1, y1);
+        roads->addLineTo(x2, y2);
+    }
+    canvas->addFigure(roads);
+
+    cPathFigure *cans = new cPathFigure("canSites");
+    cans->setLineColor(cFigure::GREEN);
+    cans->setLineWidth(2);
+    for (const RoadNetwork::CanSite& site : sites) {
+        cans->addMoveTo(site.x - 5, site.y);
+        cans->addLineTo(site.x + 5, site.y);
+        cans->addMoveTo(site.x, site.y - 5);
+        cans->addLineTo(site.x, site.y + 5);
+    }
+    canvas->addFigure(cans);
+
+    getDisplayString().setTagArg("bgb", 0, (long)std::max(3450.0, roadNetwork->getMaxX() + 100));
+    getDisplayString().setTagArg("bgb", 1, (long)std::max(1250.0, roadNetwork->getMaxY() + 100));
+}
+
+void GarbageCollectionSystem::nodePosition(cModule *node, double& x, double& y){
+    auto it = layoutPositions.find(node);
+    if (it != layoutPositions.end()) {
+        x = it->second.x;
+        y = it->second.y;
+    }
+    else {
+        x = node->par("x");
+        y = node->par("y");
+    }
+}
+
+Coord GarbageCollectionSystem::waypointOf(cModule *can){
+    auto it = layoutWaypoints.find(can);
+    if (it != layoutWaypoints.end())
+        return it->second;
+    if (can == canNode)
+        return Coord(hostNode->par("waypointCanX").doubleValue(), hostNode->par("waypointCanY").doubleValue());
+    return Coord(hostNode->par("waypointAnotherCanX").doubleValue(), hostNode->par("waypointAnotherCanY").doubleValue());
+}
+
+void GarbageCollectionSystem::stopAtStart(){
+    if (earlyStopTimer) return;
+    earlyStopTimer = new cMessage("earlyStop");
+    scheduleAt(simTime(), earlyStopTimer);
+}
+
+long GarbageCollectionSystem::residentBytes(){
+    std::ifstream statm("/proc/self/statm");
+    long sizePages = 0, residentPages = 0;
+    if (!(statm >> sizePages >> residentPages))
+        return 0;
+    return residentPages * sysconf(_SC_PAGESIZE);
+}
+
+// Setup benchmark, wall time and memory from this module's construction until every module has initialized
+void GarbageCollectionSystem::recordSetupCost(){
+    double wallSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - constructedAt).count();
+    long resident = residentBytes() - residentAtConstruction;
+
+    long cans = 2 + par("numExtraCans").intValue();
+    if (cModule *field = getSubmodule("field"))
+        cans += field->par("numCans").intValue() > 0 ? field->par("numCans").intValue() : (long)canSites.size();
+
+    recordScalar("setupWallTime", wallSec, "s");
+    recordScalar("setupResidentBytes", resident, "B");
+    recordScalar("setupCans", cans);
+    recordScalar("setupBytesPerCan", (double)resident / cans, "B");
+    EV << "Setup of " << cans << " cans took " << wallSec * 1000 << "ms and " << resident / 1024 << "KiB\n";
+}
+
+void GarbageCollectionSystem::placeNodes(){
+    for (cModule::SubmoduleIterator it(this); !it.end(); ++it) {
+        Node *node = dynamic_cast<Node *>(*it);
+        if (!node)
+            continue;
+        bool isCan = node == canNode || node == anotherCanNode || strcmp(node->getName(), "extraCan") == 0;
+        double x, y;
+        nodePosition(node, x, y);
+        node->positionIndex = positions.add(x, y, node->par("range"), isCan);
+    }
+}
+
+int GarbageCollectionSystem::getCanSlot(Node *can){
+    return positions.canSlotOf(can->positionIndex);
+}
+
+void GarbageCollectionSystem::runPositionBenchmark(){
+    int rounds = par("positionBenchmarkRounds");
+    double hostX = positions.getX(hostNode->positionIndex), hostY = positions.getY(hostNode->positionIndex);
+    double hostRange = positions.getRange(hostNode->positionIndex);
+    double propSpeed = fastCellularLink->getPropSpeed();
+    int numCans = positions.getNumCans();
+
+    // Both paths read the same arrays of the store, so the difference is the vectorization alone
+    PositionStore::CanScan scalar;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        positions.scanCansScalar(hostX, hostY, hostRange, propSpeed, scalar);
+    double scalarSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    PositionStore::CanScan scan;
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+        positions.scanCans(hostX, hostY, hostRange, propSpeed, scan);
+    double kernelSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    long mismatches = 0;
+    for (int i = 0; i < numCans; i++)
+        if (scan.inRange[i] != scalar.inRange[i] || std::fabs(scan.propagationDelay[i] - scalar.propagationDelay[i]) > 1e-12)
+            mismatches++;
+
+    recordScalar("positionScanCans", numCans);
+    recordScalar("positionScanScalarTime", scalarSec / rounds, "s");
+    recordScalar("positionScanKernelTime", kernelSec / rounds, "s");
+    if (kernelSec > 0)
+        recordScalar("positionScanSpeedup", scalarSec / kernelSec);
+    recordScalar("positionScanMismatches", mismatches);
+    EV << "Scan of " << numCans << " cans: scalar " << scalarSec / rounds * 1e6 << "us, kernel " << kernelSec / rounds * 1e6 << "us\n";
+}
+
+// Only self messages arrive here
+void GarbageCollectionSystem::handleMessage(cMessage *msg){
+    if (msg == wheelTickTimer) {
+        handleWheelTick();
+        return;
+    }
+
+    if (msg == setupDoneTimer) {
+        recordSetupCost();
+        delete msg;
+        setupDoneTimer = nullptr;
+        if (par("setupBenchmarkEndsRun").boolValue())
+            endSimulation();
+        return;
+    }
+
+    if (msg == positionBenchmarkTimer) {
+        runPositionBenchmark();
+        delete msg;
+        positionBenchmarkTimer = nullptr;
+        endSimulation();
+        return;
+    }
+
+    if (msg == earlyStopTimer) {
+        delete msg;
+        earlyStopTimer = nullptr;
+        endSimulation();
+    }
+}
+
+void GarbageCollectionSystem::scheduleTimer(WheelTimer *timer, simtime_t at){
+    Enter_Method_Silent();
+
+    // An empty wheel jumps to the present instead of stepping through the idle ticks
+    if (timerWheel->size() == 0)
+        timerWheel->skipTo(simTime().raw() / timerWheelTick.raw());
+
+    int64_t tick = (at.raw() + timerWheelTick.raw() - 1) / timerWheelTick.raw();
+    timerWheel->schedule(timer, tick);
+    scheduleWheelTick();
+}
+
+// O(1), the tick event stays where it is and finds nothing to fire if this was its only timer
+void GarbageCollectionSystem::cancelTimer(WheelTimer *timer){
+    if (timer->scheduled)
+        wheelTimersCancelled++;
+    timerWheel->cancel(timer);
+}
+
+void GarbageCollectionSystem::scheduleWheelTick(){
+    int64_t tick = timerWheel->nextTick();
+    if (tick < 0)
+        return;
+
+    // Timers scheduled during the current tick's batch go to the next tick
+    simtime_t at = std::max(simTime(), SimTime::fromRaw(tick * timerWheelTick.raw()));
+    if (wheelTickTimer->isScheduled()) {
+        if (wheelTickTimer->getArrivalTime() <= at)
+            return;
+        cancelEvent(wheelTickTimer);
+    }
+    scheduleAt(at, wheelTickTimer);
+}
+
+void GarbageCollectionSystem::handleWheelTick(){
+    wheelTicks++;
+    expiredTimers.clear();
+    timerWheel->advance(simTime().raw() / timerWheelTick.raw(), expiredTimers);
+
+    // A timer cancelled or rescheduled by an earlier one of the batch no longer belongs to it
+    long batch = 0;
+    for (WheelTimer *timer : expiredTimers) {
+        if (!timer->scheduled || timer->level >= 0)
+            continue;
+        timer->scheduled = false;
+        batch++;
+        timer->client->wheelTimerFired(timer);
+    }
+    wheelTimersFired += batch;
+    wheelMaxBatch = std::max(wheelMaxBatch, batch);
+
+    scheduleWheelTick();
+}
+
+// True if the active config is the given config or extends it, directly or indirectly
+bool GarbageCollectionSystem::activeConfigExtends(const char *name){
+    for (const std::string& config : getEnvir()->getConfigEx()->getConfigChain(configName))
+        if (config == name)
+            return true;
+    return false;
+}
+
+// Simulation time in trace microseconds
+static double traceTimestamp(){
+    return simTime().dbl() * 1e6;
 }
 
 // Enum as an easy index into a predefines array, also created an id field which can be accessed
-cMessage *GarbageCollectionSystem::createMessage(MsgID id){
+cPacket *GarbageCollectionSystem::createMessage(MsgID id){
     static const char *names[] = {
         "",                       // 0 unused
         "1-Is the can full?",
@@ -77,19 +534,167 @@ cMessage *GarbageCollectionSystem::createMessage(MsgID id){
         "7-Collect garbage",
         "8-OK",
         "9-Collect garbage",
-        "10-OK"
+        "10-OK",
+        "11-Summary",
+        "12-Which of you are full?",
+        "13-Discovery reply",
+        "14-Fill state beacon",
+        "15-Telemetry",
+        "16-Fill report"
     };
 
-    cMessage *msg = new cMessage(names[id]);
+    TrafficClass trafficClass = CLASS_SIGNALING;
+    if (id >= MSG_7_COLLECT_GARBAGE && id <= MSG_10_OK) trafficClass = CLASS_CONTROL;
+    else if (id == MSG_11_SUMMARY || id == MSG_15_TELEMETRY || id == MSG_16_FILL_REPORT) trafficClass = CLASS_BULK;
+
+    cPacket *msg = new cPacket(names[id]);
     msg->addPar("msgId") = static_cast<int>(id);
+    msg->addPar("class") = static_cast<int>(trafficClass);
+    msg->setByteLength(messageBytes);
+
+    // Created by whichever node is handling its event, marks where a flow's message came from
+    if (trace && getSimulation()->getContextModule())
+        trace->instant(getId(), getSimulation()->getContextModule()->getId(), std::string("create ") + names[id], "message", traceTimestamp());
     return msg;
 }
 
+TrafficClass GarbageCollectionSystem::getTrafficClass(cMessage *msg){
+    return msg->hasPar("class") ? (TrafficClass)(int)msg->par("class") : CLASS_SIGNALING;
+}
+
+void GarbageCollectionSystem::recordQueueingDelay(cMessage *msg, simtime_t delay){
+    classQueueingDelay[getTrafficClass(msg)].collect(delay);
+}
+
+void GarbageCollectionSystem::recordLatency(cMessage *msg){
+    classLatency[getTrafficClass(msg)].collect(simTime() - msg->getCreationTime());
+}
+
+// Replies carry the requester's sequence number back, so pipelined queries can be matched out of order,
+// and the request's timestamp, so the requester knows when the answered request was sent
+cMessage *GarbageCollectionSystem::createReply(cMessage *request, MsgID id){
+    cMessage *reply = createMessage(id);
+    reply->setTimestamp(request->getTimestamp());
+    if (request->hasPar("seq"))
+        reply->addPar("seq") = (long)request->par("seq");
+    if (request->hasPar("flow"))
+        reply->addPar("flow") = (long)request->par("flow"); // Cellular core flow the reply goes back to
+    if (request->hasPar("viaFog"))
+        reply->addPar("viaFog") = true;                      // The can forwarded the collect request for a hybrid host
+    if (request->hasPar("can"))
+        reply->addPar("can") = (long)request->par("can");   // Can of the can field the exchange is about
+    return reply;
+}
+
+void GarbageCollectionSystem::traceSend(cModule *from, cMessage *msg){
+    if (!trace) return;
+    trace->slice(getId(), from->getId(), std::string("send ") + msg->getName(), "message", traceTimestamp(), 1, msg->getTreeId());
+    trace->flowStart(getId(), from->getId(), msg->getId(), msg->getName(), traceTimestamp());
+}
+
+// A self message is a timer firing, anything else ends the flow its send started
+void GarbageCollectionSystem::traceReceive(cModule *at, cMessage *msg){
+    if (!trace) return;
+    if (msg->isSelfMessage()) {
+        trace->instant(getId(), at->getId(), std::string("timer ") + msg->getName(), "timer", traceTimestamp());
+        return;
+    }
+    trace->slice(getId(), at->getId(), std::string("recv ") + msg->getName(), "message", traceTimestamp(), 1, msg->getTreeId());
+    trace->flowEnd(getId(), at->getId(), msg->getId(), msg->getName(), traceTimestamp());
+}
+
+void GarbageCollectionSystem::traceEvent(cModule *at, const std::string& name){
+    if (!trace) return;
+    trace->instant(getId(), at->getId(), name, "route", traceTimestamp());
+}
+
+void GarbageCollectionSystem::gotoState(cModule *by, int state){
+    static const char *fastStates[] = {"", "SEND_TO_CAN", "SEND_TO_ANOTHER_CAN", "EXIT"};
+    static const char *slowStates[] = {"", "SEND_TO_CAN", "SEND_TO_CAN_CLOUD", "SEND_TO_ANOTHER_CAN", "SEND_TO_ANOTHER_CAN_CLOUD", "EXIT"};
+    static const char *emptyStates[] = {"", "SEND_TO_CAN", "SEND_TO_ANOTHER_CAN", "EXIT"};
+    const char **names = fsmType == SLOW ? slowStates : fsmType == FAST ? fastStates : emptyStates;
+
+    if (trace) {
+        std::ostringstream name;
+        name << currentFsm->getName() << ": " << names[currentFsm->getState()] << " -> " << names[state];
+        trace->instant(getId(), by->getId(), name.str(), "fsm", traceTimestamp());
+    }
+    FSM_Goto(*currentFsm, state);
+}
+
 // Get the id for a message
 int GarbageCollectionSystem::getMsgId(cMessage *msg){
     return (int)(msg->hasPar("msgId") ? msg->par("msgId") : 0); // Fallback to 0 for invalid message type
 }
 
+// Remember the newest text for a figure, applied on the next refreshDisplay()
+void GarbageCollectionSystem::markTextDirty(cTextFigure *figure, const char *text){
+    if (!hasGUI) return; // Nothing is drawn under Cmdenv
+
+    if (!coalesceFigureUpdates) {
+        figure->setText(text);
+        return;
+    }
+
+    PendingFigureUpdate& update = dirtyFigures[figure];
+    update.text = text;
+    update.textDirty = true;
+}
+
+// Remember the newest position for a text figure
+void GarbageCollectionSystem::markPositionDirty(cTextFigure *figure, const cFigure::Point& position){
+    if (!hasGUI) return;
+
+    if (!coalesceFigureUpdates) {
+        figure->setPosition(position);
+        return;
+    }
+
+    PendingFigureUpdate& update = dirtyFigures[figure];
+    update.position = position;
+    update.positionDirty = true;
+}
+
+// Remember the newest bounds for a coverage circle
+void GarbageCollectionSystem::markBoundsDirty(cOvalFigure *figure, const cFigure::Rectangle& bounds){
+    if (!hasGUI) return;
+
+    if (!coalesceFigureUpdates) {
+        figure->setBounds(bounds);
+        return;
+    }
+
+    PendingFigureUpdate& update = dirtyFigures[figure];
+    update.bounds = bounds;
+    update.boundsDirty = true;
+}
+
+// Called by the GUI once per frame, applies only the last change made to each figure since the previous frame
+void GarbageCollectionSystem::refreshDisplay() const{
+    for (auto& entry : dirtyFigures) {
+        const PendingFigureUpdate& update = entry.second;
+        // Text and position are only marked on text figures, bounds only on ovals
+        if (update.textDirty)
+            static_cast<cTextFigure *>(entry.first)->setText(update.text.c_str());
+        if (update.positionDirty)
+            static_cast<cTextFigure *>(entry.first)->setPosition(update.position);
+        if (update.boundsDirty)
+            static_cast<cOvalFigure *>(entry.first)->setBounds(update.bounds);
+    }
+    dirtyFigures.clear();
+}
+
+double GarbageCollectionSystem::getPathDelay(cMessage *msg){
+    return msg->hasPar("pathDelay") ? msg->par("pathDelay").doubleValue() : 0;
+}
+
+void GarbageCollectionSystem::setPathDelay(cMessage *msg, double delay){
+    if (msg->hasPar("pathDelay"))
+        msg->par("pathDelay") = delay;
+    else
+        msg->addPar("pathDelay") = delay;
+}
+
 // Render empty statistics initially
 void GarbageCollectionSystem::renderInitialDelayStats(){
     delayStatsHeader = new cTextFigure("headerDelayStats");
@@ -142,6 +747,32 @@ cTextFigure *GarbageCollectionSystem::makeStatFigure(const char* name, int stepM
 
 // Simply writes to a stream based on which config is active, the final delay values and sets the figure text with final info
 void GarbageCollectionSystem::finish(){
+    for (int c = 0; c < NUM_TRAFFIC_CLASSES; c++) {
+        if (classQueueingDelay[c].getCount() > 0)
+            classQueueingDelay[c].record();
+        if (classLatency[c].getCount() > 0)
+            classLatency[c].record();
+    }
+
+    if (timerWheel) {
+        recordScalar("wheelTicks", wheelTicks);
+        recordScalar("wheelTimersFired", wheelTimersFired);
+        recordScalar("wheelTimersCancelled", wheelTimersCancelled);
+        recordScalar("wheelMaxBatch", wheelMaxBatch);
+        recordScalar("wheelCascaded", timerWheel->getCascaded());
+    }
+
+    if (trace) {
+        recordScalar("traceEvents", trace->getNumEvents());
+        trace->close();
+    }
+
+    if (analyticEstimate)
+        validateAnalyticEstimate();
+
+    if (sequentialStopping && !skipReplication)
+        finishReplication();
+
     std::ostringstream hostOut, canOut, anotherCanOut, cloudOut;
 
     switch (fsmType) {
@@ -211,3 +842,211 @@ void GarbageCollectionSystem::finish(){
     anotherCanDelayStats->setText(anotherCanOut.str().c_str());
     cloudDelayStats->setText(cloudOut.str().c_str());
 }
+
+// PER of the channel starting at the given output gate, 0 if it is not a RealisticDelayChannel
+static double lossOnLink(cGate *outGate, double distanceM){
+    auto channel = dynamic_cast<RealisticDelayChannel *>(outGate->getChannel());
+    return channel ? channel->packetErrorRate(distanceM) : 0;
+}
+
+// Collect the hops of a visit to the given can, with the host standing at the waypoint
+VisitHops GarbageCollectionSystem::visitHops(cModule *can, double waypointX, double waypointY, double fastScale, double slowScale){
+    double canX, canY, cloudX, cloudY, upstreamX, upstreamY;
+    nodePosition(can, canX, canY);
+    nodePosition(cloudNode, cloudX, cloudY);
+    nodePosition(fogUpstreamNode, upstreamX, upstreamY);
+    double hostToCan = std::hypot(waypointX - canX, waypointY - canY);
+    double canToCloud = std::hypot(canX - upstreamX, canY - upstreamY); // With a gateway the fog hops end there
+    double hostToCloud = std::hypot(waypointX - cloudX, waypointY - cloudY);
+
+    // Delays come from the same links the nodes use for their statistics
+    VisitHops hops;
+    hops.query = fastCellularLink->hopModel(hostToCan, fastScale);
+    hops.reply = fastCellularLink->hopModel(hostToCan, fastScale);
+    hops.fogUp = fastWiFiLink->hopModel(canToCloud, fastScale);
+    hops.fogDown = fastWiFiLink->hopModel(canToCloud, fastScale);
+    hops.cloudUp = slowCellularLink->hopModel(hostToCloud, slowScale);
+    hops.cloudDown = slowCellularLink->hopModel(hostToCloud, slowScale);
+
+    // Losses are per direction, so take them from the channels the query and reply actually travel on
+    hops.query.lossProbability = lossOnLink(can->gate("gate$i", 0)->getPreviousGate(), hostToCan);
+    hops.reply.lossProbability = lossOnLink(can->gate("gate$o", 0), hostToCan);
+
+    hops.dropLimit = can->par("dropLimit");
+    return hops;
+}
+
+// Latency of one can visit from the first query until the host may move on, following the FSM message sequence
+LatencyDistribution GarbageCollectionSystem::estimateVisit(const LatencyEstimator& estimator, FsmType strategy, const VisitHops& hops){
+    double answerProbability = (1 - hops.query.lossProbability) * (1 - hops.reply.lossProbability);
+
+    switch (strategy) {
+        case FAST:
+            // The host moves on when the OK reaches the can, the reply to the host is off the critical path
+            return estimator.withRetries(estimator.chain({hops.query, hops.fogUp, hops.fogDown}),
+                                         hops.dropLimit, HOST_RETRY_INTERVAL, 1 - hops.query.lossProbability);
+        case SLOW: {
+            // Answer from the can first, then the host asks the cloud itself
+            LatencyDistribution answered = estimator.withRetries(estimator.chain({hops.query, hops.reply}),
+                                                                 hops.dropLimit, HOST_RETRY_INTERVAL, answerProbability);
+            return estimator.convolve(answered, estimator.chain({hops.cloudUp, hops.cloudDown}));
+        }
+        case EMPTY:
+        default:
+            return estimator.withRetries(estimator.chain({hops.query, hops.reply}),
+                                         hops.dropLimit, HOST_RETRY_INTERVAL, answerProbability);
+    }
+}
+
+// Both can visits of the route, driving time is not included
+LatencyDistribution GarbageCollectionSystem::estimateRoute(const LatencyEstimator& estimator, FsmType strategy, double fastScale, double slowScale){
+    VisitHops canHops = visitHops(canNode, waypointOf(canNode).x, waypointOf(canNode).y, fastScale, slowScale);
+    VisitHops anotherCanHops = visitHops(anotherCanNode, waypointOf(anotherCanNode).x, waypointOf(anotherCanNode).y, fastScale, slowScale);
+    return estimator.convolve(estimateVisit(estimator, strategy, canHops), estimateVisit(estimator, strategy, anotherCanHops));
+}
+
+// Records the estimate for the configured parameters and optionally sweeps a grid of base latency scales
+void GarbageCollectionSystem::runAnalyticEstimate(){
+    LatencyEstimator estimator(par("estimatorBinSize").doubleValue());
+    static const FsmType strategies[] = {FAST, SLOW, EMPTY};
+    static const char *strategyNames[] = {"Fast", "Slow", "Empty"}; // Indexed by FsmType
+
+    for (FsmType strategy : strategies) {
+        LatencyDistribution route = estimateRoute(estimator, strategy, 1, 1);
+        std::string prefix = std::string("analytic") + strategyNames[strategy] + "Route";
+        recordScalar((prefix + "LatencyMean").c_str(), route.mean(), "s");
+        recordScalar((prefix + "LatencyP50").c_str(), route.quantile(0.50), "s");
+        recordScalar((prefix + "LatencyP99").c_str(), route.quantile(0.99), "s");
+        EV << "Analytic " << strategyNames[strategy] << " route latency: mean " << route.mean()
+           << "s, P99 " << route.quantile(0.99) << "s\n";
+    }
+
+    predictedDelayTotal = predictModeledDelayTotal();
+
+    // Design space sweep, fog links (host-can, can-cloud) on one axis and the cloud link on the other
+    const char *sweepFile = par("estimatorSweepFile");
+    if (*sweepFile == '\0') return;
+
+    std::ofstream out(sweepFile);
+    if (!out)
+        throw cRuntimeError("Cannot open estimatorSweepFile '%s'", sweepFile);
+    out << "fastScale,slowScale,strategy,meanMs,p50Ms,p99Ms\n";
+
+    double scaleMin = par("estimatorScaleMin");
+    double scaleMax = par("estimatorScaleMax");
+    int steps = par("estimatorScaleSteps");
+    auto scaleAt = [&](int i) { return steps > 1 ? scaleMin + (scaleMax - scaleMin) * i / (steps - 1) : scaleMin; };
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < steps; i++) {
+        for (int j = 0; j < steps; j++) {
+            for (FsmType strategy : strategies) {
+                LatencyDistribution route = estimateRoute(estimator, strategy, scaleAt(i), scaleAt(j));
+                out << scaleAt(i) << "," << scaleAt(j) << "," << strategyNames[strategy] << ","
+                    << route.mean() * 1000 << "," << route.quantile(0.50) * 1000 << "," << route.quantile(0.99) * 1000 << "\n";
+            }
+        }
+    }
+    double wallSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    recordScalar("analyticSweepGridPoints", steps * steps);
+    recordScalar("analyticSweepWallTime", wallSec, "s");
+    EV << "Analytic sweep of " << steps * steps << " grid points took " << wallSec * 1000 << "ms\n";
+}
+
+// Expected sum of the delays the nodes add to GlobalDelays during one route, only defined when retries are deterministic
+double GarbageCollectionSystem::predictModeledDelayTotal(){
+    auto hopMean = [](const HopModel& hop) { return hop.baseSec + hop.propagationSec; }; // The jitter is symmetric
+
+    // Gateway summaries add backhaul delays that are not part of any visit, broadcasts reach every can in coverage
+    if (gatewayNode || broadcastDiscovery || beaconMode != BEACON_NONE) return -1;
+
+    VisitHops visits[] = {
+        visitHops(canNode, waypointOf(canNode).x, waypointOf(canNode).y, 1, 1),
+        visitHops(anotherCanNode, waypointOf(anotherCanNode).x, waypointOf(anotherCanNode).y, 1, 1)
+    };
+
+    double total = 0;
+    for (const VisitHops& hops : visits) {
+        if (hops.query.lossProbability > 0 || hops.reply.lossProbability > 0)
+            return -1;
+
+        // Every query gets a delay computed when it is sent, also the ones the can drops
+        total += (hops.dropLimit + 1) * hopMean(hops.query) + hopMean(hops.reply);
+        if (fsmType == FAST) total += hopMean(hops.fogUp) + hopMean(hops.fogDown);
+        if (fsmType == SLOW) total += hopMean(hops.cloudUp) + hopMean(hops.cloudDown);
+    }
+    return total;
+}
+
+// Compares the analytic prediction with the delays accumulated by the simulated run
+void GarbageCollectionSystem::validateAnalyticEstimate(){
+    if (predictedDelayTotal < 0) {
+        EV << "Analytic validation skipped, retries are random with the loss model and gateway summaries and broadcasts are not part of the per-visit model\n";
+        return;
+    }
+
+    int state = currentFsm->getState();
+    bool routeDone = (fsmType == FAST && state == FAST_EXIT) || (fsmType == SLOW && state == SLOW_EXIT) || (fsmType == EMPTY && state == EMPTY_EXIT);
+    if (!routeDone) {
+        EV << "Analytic validation skipped, the route was not completed\n";
+        return;
+    }
+
+    double simulated = GlobalDelays.fast_smartphone_to_others + GlobalDelays.fast_others_to_smartphone
+                     + GlobalDelays.slow_smartphone_to_others + GlobalDelays.slow_others_to_smartphone
+                     + GlobalDelays.fast_others_to_cloud + GlobalDelays.fast_cloud_to_others;
+    double relativeError = (simulated - predictedDelayTotal) / predictedDelayTotal;
+
+    recordScalar("analyticPredictedDelayTotal", predictedDelayTotal, "s");
+    recordScalar("simulatedDelayTotal", simulated, "s");
+    recordScalar("analyticRelativeError", relativeError);
+
+    if (std::fabs(relativeError) > par("estimatorValidationTolerance").doubleValue())
+        EV_WARN << "Analytic estimate is off by " << relativeError * 100 << "% from the simulated run\n";
+}
+
+// Mean and P99 of the delays one link produced during this run
+static void addLinkResult(std::vector<SequentialStopping::LinkResult>& results, const char *link, RealisticDelayChannel *channel){
+    std::vector<double> samples = channel->getDelaySamples();
+    if (samples.empty()) return; // Link not used by this strategy
+
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (double sample : samples) sum += sample;
+
+    SequentialStopping::LinkResult result;
+    result.link = link;
+    result.mean = sum / samples.size();
+    result.p99 = samples[(size_t)std::ceil(0.99 * samples.size()) - 1];
+    results.push_back(result);
+}
+
+// Adds this replication to the running estimates and reports whether more replications are needed
+void GarbageCollectionSystem::finishReplication(){
+    double cpuSeconds = double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+
+    std::vector<SequentialStopping::LinkResult> results;
+    addLinkResult(results, "fastCellular", fastCellularLink);
+    addLinkResult(results, "fastWiFi", fastWiFiLink);
+    addLinkResult(results, "slowCellular", slowCellularLink);
+
+    sequentialStopping->append(getEnvir()->getConfigEx()->getActiveRunNumber(), cpuSeconds, results);
+
+    for (auto& entry : sequentialStopping->meanEstimates()) {
+        recordScalar((entry.first + "MeanLatency").c_str(), entry.second.mean, "s");
+        recordScalar((entry.first + "MeanRelativeHalfWidth").c_str(), entry.second.relativeHalfWidth);
+    }
+    for (auto& entry : sequentialStopping->p99Estimates()) {
+        recordScalar((entry.first + "P99Latency").c_str(), entry.second.mean, "s");
+        recordScalar((entry.first + "P99RelativeHalfWidth").c_str(), entry.second.relativeHalfWidth);
+    }
+    recordScalar("sequentialReplications", sequentialStopping->getNumReplications());
+    recordScalar("sequentialCpuSeconds", sequentialStopping->getCpuSecondsUsed(), "s");
+    recordScalar("sequentialStop", sequentialStopping->shouldStop());
+
+    if (sequentialStopping->targetReached())
+        EV << "Sequential stopping: precision target met after " << sequentialStopping->getNumReplications() << " replications\n";
+    else if (sequentialStopping->budgetExhausted())
+        EV << "Sequential stopping: CPU budget used up after " << sequentialStopping->getNumReplications() << " replications\n";
+}
@@ -9,9 +9,18 @@
 #define GARBAGECOLLECTIONSYSTEM_H_
 
 #include <string.h>
+#include <map>
 #include <omnetpp.h>
 #include "inet/common/INETDefs.h"
 #include "inet/common/geometry/common/Coord.h"
+#include "LatencyEstimator.h"
+#include "SequentialStopping.h"
+#include "TraceWriter.h"
+#include "RoadNetwork.h"
+#include "TimerWheel.h"
+#include "PositionStore.h"
+#include <chrono>
+#include <ctime>
 
 using namespace omnetpp;
 using namespace inet;
@@ -34,6 +43,14 @@ struct LinkDelays {
 // Expose the structure globally
 extern LinkDelays GlobalDelays;
 
+// Hops of one can visit, as the delay statistics of the nodes model them
+struct VisitHops {
+    HopModel query, reply;          // host <-> can, fast cellular
+    HopModel fogUp, fogDown;        // can <-> cloud, fast Wi-Fi
+    HopModel cloudUp, cloudDown;    // host <-> cloud, slow cellular
+    int dropLimit = 0;              // Deterministic drops at the can
+};
+
 // Enum for all system messages
 enum MsgID {
     MSG_1_IS_CAN_FULL = 1,
@@ -45,7 +62,21 @@ enum MsgID {
     MSG_7_COLLECT_GARBAGE,
     MSG_8_OK,
     MSG_9_COLLECT_GARBAGE,
-    MSG_10_OK
+    MSG_10_OK,
+    MSG_11_SUMMARY, // Batch of collect records from an edge gateway to the cloud
+    MSG_12_DISCOVER, // Host broadcast to every can in coverage
+    MSG_13_DISCOVERY_REPLY, // A can's answer to the broadcast, par "full"
+    MSG_14_BEACON, // Fill state pushed by a can, par "full"
+    MSG_15_TELEMETRY, // Background upload from a node, nothing answers it
+    MSG_16_FILL_REPORT // Fill level of a can field can to the cloud, pars "can" and "fill"
+};
+
+// Traffic class of a message, decides its place in the transmit queues, in priority order
+enum TrafficClass {
+    CLASS_CONTROL,    // Collect commands and their OKs
+    CLASS_SIGNALING,  // Fill state queries and answers, discovery and beacons
+    CLASS_BULK,       // Gateway summaries and telemetry
+    NUM_TRAFFIC_CLASSES
 };
 
 class GarbageCollectionSystem : public cSimpleModule{
@@ -63,6 +94,63 @@ protected:
     static constexpr int VERTICAL_BODY_STEP_SIZE = 100;
     static constexpr int FONT_SIZE = 35;
 
+    // Figure changes waiting for the next GUI frame, one entry per figure so repeated updates overwrite each other
+    struct PendingFigureUpdate {
+        std::string text;
+        cFigure::Point position;
+        cFigure::Rectangle bounds;
+        bool textDirty = false;
+        bool positionDirty = false;
+        bool boundsDirty = false;
+    };
+    mutable std::map<cFigure *, PendingFigureUpdate> dirtyFigures; // Flushed from refreshDisplay() which is const
+    bool coalesceFigureUpdates = true;
+    bool hasGUI = false;
+
+    // Analytic estimator state, the predicted total is compared with the simulated GlobalDelays in finish()
+    bool analyticEstimate = false;
+    double predictedDelayTotal = -1; // < 0 when the prediction is not comparable (random retries)
+    cMessage *earlyStopTimer = nullptr; // Ends the run at t=0 when no event simulation is needed
+
+    // Sequential stopping across replications, null when disabled
+    SequentialStopping *sequentialStopping = nullptr;
+    bool skipReplication = false;
+    std::clock_t cpuStart = 0;
+
+    // Per class delays of the transmit queues, queueing is time waiting for the link, latency is creation to arrival
+    cHistogram classQueueingDelay[NUM_TRAFFIC_CLASSES];
+    cHistogram classLatency[NUM_TRAFFIC_CLASSES];
+    long messageBytes = 0;
+
+    // Chrome trace export of message flows, nullptr when traceFile is empty
+    TraceWriter *trace = nullptr;
+
+    // Loaded road network and can layout, nullptr keeps the NED positions and the turtle.xml legs
+    RoadNetwork *roadNetwork = nullptr;
+    std::map<cModule *, cFigure::Point> layoutPositions; // Node positions taken from the layout
+    std::map<cModule *, Coord> layoutWaypoints;          // Where the host stops for each can, its snapped road position
+    cXMLElement *roadRoute = nullptr;                    // Generated legs, same ids as turtle.xml
+    std::vector<RoadNetwork::CanSite> canSites;          // All rows of the can layout
+
+    // Network setup cost, measured from the construction of this module, which is created before its submodules
+    std::chrono::steady_clock::time_point constructedAt = std::chrono::steady_clock::now();
+    long residentAtConstruction = residentBytes();
+    cMessage *setupDoneTimer = nullptr; // First event after all modules have initialized
+
+    // Coordinates of all nodes, the cans in scan order
+    PositionStore positions;
+    cMessage *positionBenchmarkTimer = nullptr; // Runs the position benchmark after the setup events and ends the run
+
+    // Timer wheel for the host timers, nullptr when timerWheelTick is 0. One self message serves every timer of its tick
+    TimerWheel *timerWheel = nullptr;
+    simtime_t timerWheelTick;
+    cMessage *wheelTickTimer = nullptr;
+    std::vector<WheelTimer *> expiredTimers;
+    long wheelTicks = 0;      // Events of wheelTickTimer
+    long wheelTimersFired = 0;
+    long wheelTimersCancelled = 0;
+    long wheelMaxBatch = 0;
+
 public:
     // Relevant system variables which are widely used across the system files
     cCanvas *canvas                         = nullptr;
@@ -72,13 +160,30 @@ public:
     Node* anotherCanNode                    = nullptr;
     Node* cloudNode                         = nullptr;
     Node* hostNode                          = nullptr;
+    Node* gatewayNode                       = nullptr; // Only with useEdgeGateway
+    Node* fogUpstreamNode                   = nullptr; // Where the cans send collect requests, the gateway or the cloud
+    bool broadcastDiscovery                 = false;   // Host queries go out as one broadcast over the shared medium
+    bool canFieldOnRoute                    = false;   // The host's stops are cans of the can field, can and anotherCan stay idle
+
+    // Push mode, the cans send their fill state and the host stops polling
+    enum BeaconMode { BEACON_NONE, BEACON_ENTRY, BEACON_PERIODIC };
+    BeaconMode beaconMode                   = BEACON_NONE;
+
+    // Order in which the nodes' transmit queues are served when a link is busy
+    enum LinkScheduling { SCHEDULE_FIFO, SCHEDULE_PRIORITY, SCHEDULE_WRR };
+    LinkScheduling linkScheduling           = SCHEDULE_FIFO;
+    int classWeights[NUM_TRAFFIC_CLASSES]   = {1, 1, 1}; // Messages per turn with SCHEDULE_WRR
 
     RealisticDelayChannel *slowCellularLink = nullptr;
     RealisticDelayChannel *fastCellularLink = nullptr;
     RealisticDelayChannel *fastWiFiLink     = nullptr;
+    RealisticDelayChannel *backhaulLink     = nullptr; // Gateway to cloud, only with useEdgeGateway
 
     double range = 0;
 
+    // Seconds between the host's polls of a can while waiting for an answer
+    static constexpr double HOST_RETRY_INTERVAL = 1;
+
     // Easy lookup of config, no need to str compare
     enum FsmType { FAST, SLOW, EMPTY };
     FsmType fsmType;
@@ -111,16 +216,99 @@ protected:
     // builting omnet overrides
     virtual void initialize() override;
     virtual void finish() override;
+    virtual void refreshDisplay() const override; // Flushes dirty figures at most once per GUI frame
+    virtual void handleMessage(cMessage *msg) override;
 
     // For rendering the initial delays
     void renderInitialDelayStats();
 
     cTextFigure *makeStatFigure(const char* name, int stepMultiplier);
 
+    // Used for selecting the FSM, so derived configs keep the strategy of their base config
+    bool activeConfigExtends(const char *name);
+
+    // Analytic estimator, builds the hop sequence of each strategy from the channels and node positions
+    void runAnalyticEstimate();
+    VisitHops visitHops(cModule *can, double waypointX, double waypointY, double fastScale, double slowScale);
+    LatencyDistribution estimateVisit(const LatencyEstimator& estimator, FsmType strategy, const VisitHops& hops);
+    LatencyDistribution estimateRoute(const LatencyEstimator& estimator, FsmType strategy, double fastScale, double slowScale);
+    double predictModeledDelayTotal();
+    void validateAnalyticEstimate();
+
+    // Road network import, places the nodes and generates the host's legs along the fastest roads
+    void loadRoadLayout();
+    std::string routeLeg(const char *id, const std::vector<RoadNetwork::RoutePoint>& points, bool first);
+    void renderRoadLayout(const std::vector<RoadNetwork::CanSite>& sites);
+
+    // Registers every node in the position store, from the road layout or the x and y parameters
+    void placeNodes();
+
+    // Times scanCans() against scanCansScalar() on the same arrays, for positionBenchmarkRounds scans of all cans
+    void runPositionBenchmark();
+
+    // Keeps wheelTickTimer at the wheel's next tick with work, fires the expired timers of the current one
+    void scheduleWheelTick();
+    void handleWheelTick();
+
+    // Resident set size of the process, 0 where /proc is not available
+    static long residentBytes();
+    void recordSetupCost();
+
+    // Sequential stopping, ends the run right away and records this replication's per-link latency
+    void stopAtStart();
+    void finishReplication();
+
 public:
+    virtual ~GarbageCollectionSystem();
+
     // Two public methods, for creating a message with an enum value, and retireving a messages ID
-    cMessage *createMessage(MsgID id);
+    // Messages are packets of messageBytes tagged with their traffic class, so the datarate channels serialize them
+    cPacket *createMessage(MsgID id);
     int getMsgId(cMessage *msg);
+    TrafficClass getTrafficClass(cMessage *msg);
+
+    // Per class delays reported by the nodes
+    void recordQueueingDelay(cMessage *msg, simtime_t delay);
+    void recordLatency(cMessage *msg);
+
+    // Trace hooks, no-ops unless a traceFile is configured. Sends and receives become slices joined by a flow arrow
+    void traceSend(cModule *from, cMessage *msg);
+    void traceReceive(cModule *at, cMessage *msg);
+    void traceEvent(cModule *at, const std::string& name);
+
+    // FSM_Goto on the current FSM, traced as a transition on the host's track
+    void gotoState(cModule *by, int state);
+
+    // Timer wheel service, timers are rounded up to the next tick. isTimerWheelEnabled() is false when timerWheelTick is 0
+    bool isTimerWheelEnabled() const { return timerWheel != nullptr; }
+    void scheduleTimer(WheelTimer *timer, simtime_t at);
+    void cancelTimer(WheelTimer *timer);
+
+    // Central store of the node coordinates, a moving node updates its entry
+    PositionStore& getPositions() { return positions; }
+    int getCanSlot(Node *can);
+
+    // Position of a node, from the road layout when one is loaded, otherwise its x and y parameters
+    void nodePosition(cModule *node, double& x, double& y);
+
+    // Where the host stops to query a can, the layout's snapped road position or the host's waypoint parameters
+    Coord waypointOf(cModule *can);
+
+    // Legs generated from the road network, nullptr without one
+    cXMLElement *getRoadRoute() const { return roadRoute; }
+    const std::vector<RoadNetwork::CanSite>& getCanSites() const { return canSites; }
+
+    // Creates the response to a request, copying the fields a requester uses to match replies (sequence number, timestamp, core flow, field can)
+    cMessage *createReply(cMessage *request, MsgID id);
+
+    // Modeled delay a request/response exchange has accumulated along its path, carried from requests to their replies
+    double getPathDelay(cMessage *msg);
+    void setPathDelay(cMessage *msg, double delay);
+
+    // Figure update scheduler, nodes mark their figures dirty and the changes are applied once per GUI frame
+    void markTextDirty(cTextFigure *figure, const char *text);
+    void markPositionDirty(cTextFigure *figure, const cFigure::Point& position);
+    void markBoundsDirty(cOvalFigure *figure, const cFigure::Rectangle& bounds);
 };
 
 #endif /* GARBAGECOLLECTIONSYSTEM_H_ */
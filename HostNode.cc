@@ -7,14 +7,16 @@
 
 #include "TurtleMobility.h"
 #include "Node.h"
+#include "CanField.h"
 #include "inet/mobility/base/MobilityBase.h"
 #include <sstream>
+#include <map>
 
-class HostNode : public Node, public cListener{
+class HostNode : public Node, public cListener, public WheelTimerClient{
 
 protected:
 
-    // Variables for start-stop logic
+    // Variables for start-stop logic, waypoints are set from parameters
     Coord waypointCan = Coord(290, 300); // Waypoint found by visual analysis
     Coord waypointAnotherCan = Coord(290, 990); // Waypoint found by visual analysis
     bool atWaypointCan = false;
@@ -28,9 +30,94 @@ protected:
     // Resend timers for polling cans after dropped messages
     cMessage *sendCanTimer = nullptr;
     cMessage *sendAnotherCanTimer = nullptr;
+    // Their entries on the system's timer wheel, used instead of the self messages when the wheel is enabled
+    WheelTimer retryWheelTimers[2];
+
+    // Distances, coverage overlaps and propagation delays to all cans, refreshed on every mobility update
+    PositionStore::CanScan canScan;
 
     // Named gate indeces
-    enum GateIndex {GATE_CAN = 0, GATE_ANOTHER_CAN = 1, GATE_CLOUD = 2};
+    enum GateIndex {GATE_CAN = 0, GATE_ANOTHER_CAN = 1, GATE_CLOUD = 2, GATE_MEDIUM = 3};
+
+    // Can field on the route, the stops' cans are field cans found from the waypoints and queried on the field link
+    CanField *field = nullptr;
+    int fieldGate = -1;
+    int fieldCan[2] = {-1, -1};   // Can id per stop, -1 until resolved
+    int fieldSlot[2] = {-1, -1};  // Its position store slot
+
+    // Broadcast discovery, one query covers every can in coverage so the per-can timers share it
+    simtime_t lastDiscovery = -1;
+    int discoveriesSent = 0;
+
+    // Pipelined queries, every can in range is queried at once and replies are matched by sequence number
+    struct InFlightQuery {
+        int canIndex;       // GATE_CAN or GATE_ANOTHER_CAN, the can the decision is about, -1 for a broadcast
+        simtime_t sentAt;
+    };
+    bool pipelineQueries = false;
+    int maxInFlight = 4;
+    long nextSeq = 0;
+    std::map<long, InFlightQuery> inFlight;
+    bool decided[2] = {false, false}; // Decision per can is complete, the host may leave its waypoint
+    bool trackDecisions = false;      // Pipelined queries or can beacons, decisions may complete before the waypoint is reached
+    int staleReplies = 0;             // Replies to queries that were retried or already decided
+    int timedOutQueries = 0;
+    cStdDev queryLatency{"queryLatency"};
+
+    // Route timing, the final leg is the same for every mode so the departure from the last can decides the completion time
+    simtime_t waypointArrival = -1;
+    simtime_t lastCanDeparture = -1;
+    cStdDev waitAtWaypoint{"waitAtWaypoint"};
+
+    // Timeline of a can visit, coverage entry to leaving the waypoint
+    struct VisitTimeline {
+        simtime_t coverageEntry = -1;
+        simtime_t firstQuery = -1;     // First query or broadcast that could reach the can
+        simtime_t answeredQuery = -1;  // Query the first answer belongs to, the send time of a beacon
+        simtime_t answerReceived = -1;
+        simtime_t decided = -1;        // Host may leave once at the waypoint
+    };
+    VisitTimeline visits[2];
+    cStdDev timeToDecision{"timeToDecision"};
+
+    // Named phases of a visit, in timeline order, they add up to visitTotal
+    enum VisitPhase {PHASE_WAIT_FOR_WAYPOINT, PHASE_DROPS_AND_RETRIES, PHASE_CAN_ROUND_TRIP, PHASE_CLOUD_WAIT, PHASE_TO_DEPARTURE, PHASE_TOTAL, NUM_PHASES};
+    cHistogram phaseHistograms[NUM_PHASES];
+    int beaconsReceived = 0;
+
+    // Last query to a can until the host may leave it, for the tail latency of the strategies
+    simtime_t lastQuerySent[2] = {-1, -1};
+    cHistogram collectLatency{"collectLatency"};
+
+    // Hybrid paths, SLOW configs only. Each query tells the can whether to forward the collect request itself (fog) or leave
+    // it to the host (cloud), whichever path has the lower expected completion time from the query on. Only the path taken
+    // gets a new observation, so a share of the queries probes the other one to keep its estimate current
+    struct PathEstimate {
+        double mean = 0;   // Seeded with the modeled latency, replaced by the first observation
+        long samples = 0;
+        void update(double sample, double alpha) { mean = samples++ == 0 ? sample : mean + alpha * (sample - mean); }
+    };
+    bool hybridPaths = false;
+    double pathEwmaAlpha = 0.25;
+    double pathProbeProbability = 0.1;
+    bool pathPriorsSet = false;
+    PathEstimate queryRoundTrip;       // Query to the can's answer
+    PathEstimate fogCompletion;        // Query to the can's collected signal
+    PathEstimate cloudRoundTrip;       // Host collect request to the cloud's OK
+    simtime_t lastFogQuery[2] = {-1, -1};
+    simtime_t cloudRequestSent = -1;
+    int fogCollects = 0;
+    int cloudCollects = 0;
+    int pathProbes = 0;
+
+    // Look-ahead queries, sequential mode. The first query goes out once the truck is expected at the waypoint within the
+    // decision time of the earlier visits, a decision that completes before the arrival holds the next leg until the stop
+    bool lookAheadQueries = false;
+    PathEstimate decisionTime;          // First query to decision, seeded with lookAheadTime
+    const char *pendingLeg = nullptr;
+    int queriesAhead = 0;               // First queries sent before the waypoint
+    int readyOnArrival = 0;             // Visits decided by the time the truck stopped
+    simtime_t dwellTime[2] = {-1, -1};  // Waypoint arrival to departure per can
 
     // Turtle wrapper for mobility control
     Extended::TurtleMobility *mobility;
@@ -48,14 +135,24 @@ protected:
     // Omnett built-in overrides
     virtual void initialize() override;
     virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
     virtual void receiveSignal(cComponent *source, simsignal_t signalID, bool value, cObject *details) override; // onMobilityChanged emission, updates necessary components etc.
+    virtual void receiveSignal(cComponent *source, simsignal_t signalID, intval_t value, cObject *details) override; // Can id emptied by the can field
     virtual void receiveSignal(cComponent *source, simsignal_t signalID, cObject *obj, cObject *details) override; // For custom messages, used in fast config only
 
     // Methods relating to ranges and re-sending
     bool isInRangeOf(Node *target);
+    int routeFieldCan(int canIndex);
     void handleSendTimer(cMessage *msg, bool &inRage, bool &acked, bool &atWp, const char *targetName, int gateIndex, int sendState, int altSendState);
     void updateRangeState(bool nowInRange, bool &prevInRange, cMessage *timer, const char *name);
 
+    // Retry timers go through the system's timer wheel when it is enabled, otherwise they are self messages
+    void armRetryTimer(cMessage *timer);
+    void cancelRetryTimer(cMessage *timer);
+    bool isRetryTimerArmed(cMessage *timer);
+    void retryTimerFired(cMessage *timer);
+    virtual void wheelTimerFired(WheelTimer *timer) override;
+
     // Methods for handling message and state transmission
     // handleFastFsmTransistions is not defined as its not necessary for the solution
     void handleSlowFsmTransitions(cMessage *msg);
@@ -73,6 +170,50 @@ protected:
 
     // Utility method so we dont DRY
     void ackReceived(bool &ackedFlag, cMessage *timer, int nextState, int &rcvdCounter);
+
+    // Called once per can when the host may leave it
+    void visitCompleted(Node *can);
+
+    // Collected signal of the can of a stop, from the can or the can field
+    void canCollected(int canIndex);
+
+    // Sends "is the can full" to the can on gateIndex, tagged with a sequence number when pipelining
+    void sendCanQuery(int gateIndex);
+    void sendDiscovery(int gateIndex);
+
+    // Can index of a discovery reply from its sender, -1 for a node that is not a can
+    int discoveryReplyCan(cMessage *msg);
+
+    // Pipelined mode, replies complete the decision of their can and the route advances once decisions and waypoints line up
+    void handlePipelinedMessage(cMessage *msg);
+    void canAnswered(int canIndex, bool full);
+    void sendCloudCollect(int canIndex);
+    void markDecided(int canIndex);
+    void advanceRoute();
+
+    // FSM state of the config's FSM type while heading to a can, and after the last can
+    int canState(int canIndex);
+    int exitState();
+
+    // Sets the next turtle leg and records how long the host stood at the waypoint
+    void startLeg(const char *legId);
+
+    // Visit timeline bookkeeping
+    void noteQuerySent(int canIndex);
+    void noteAnswer(cMessage *msg);
+    void recordVisitPhases(int canIndex);
+
+    // Hybrid paths
+    bool chooseFogPath(int canIndex);
+    void seedPathEstimates(int canIndex);
+    bool hybridAnswer(cMessage *msg, int canIndex);
+    void hybridCollected(int canIndex);
+
+    // Look-ahead queries
+    int currentCan();
+    double secondsToWaypoint(int canIndex);
+    bool lookingAhead(int canIndex);
+    void lookAhead();
 };
 
 Define_Module(HostNode);
@@ -82,6 +223,41 @@ void HostNode::initialize(){
     // Init general fields in Node.h
     Node::initialize();
 
+    // Waypoints where the host stops to query the cans
+    waypointCan = system->waypointOf(system->canNode);
+    waypointAnotherCan = system->waypointOf(system->anotherCanNode);
+
+    // Legs generated from a loaded road network replace turtle.xml
+    if (system->getRoadRoute())
+        root = system->getRoadRoute();
+
+    pipelineQueries = par("pipelineQueries");
+    maxInFlight = par("maxInFlight");
+    trackDecisions = pipelineQueries || system->beaconMode != GarbageCollectionSystem::BEACON_NONE;
+
+    hybridPaths = par("hybridPaths");
+    pathEwmaAlpha = par("pathEwmaAlpha");
+    pathProbeProbability = par("pathProbeProbability");
+    if (hybridPaths && (system->fsmType != GarbageCollectionSystem::SLOW || trackDecisions || system->broadcastDiscovery))
+        throw cRuntimeError("hybridPaths needs a SLOW config with sequential unicast queries");
+
+    // The field link is the host's last gate
+    if (system->canFieldOnRoute) {
+        if (hybridPaths)
+            throw cRuntimeError("hybridPaths needs the CanNode modules, the can field does not forward collect requests");
+        field = check_and_cast<CanField *>(system->getSubmodule("field"));
+        fieldGate = gateSize("gate") - 1;
+    }
+
+    lookAheadQueries = par("lookAheadQueries");
+    decisionTime.mean = par("lookAheadTime").doubleValue();
+    if (lookAheadQueries && trackDecisions)
+        throw cRuntimeError("lookAheadQueries is for sequential queries, pipelined queries and beacons already decide ahead of the waypoint");
+
+    static const char *phaseNames[NUM_PHASES] = {"phaseWaitForWaypoint", "phaseDropsAndRetries", "phaseCanRoundTrip", "phaseCloudWait", "phaseToDeparture", "visitTotal"};
+    for (int i = 0; i < NUM_PHASES; i++)
+        phaseHistograms[i].setName(phaseNames[i]);
+
     // Subscribe to the signal for mobilitystatechanged
     mobility = check_and_cast<Extended::TurtleMobility*>(getSubmodule("mobility"));
     mobility->subscribe(inet::MobilityBase::mobilityStateChangedSignal, this);
@@ -89,10 +265,15 @@ void HostNode::initialize(){
     // Subscribe to collection signals
     system->canNode->subscribe(Node::garbageCollectedSignalFromCan, this);
     system->anotherCanNode->subscribe(Node::garbageCollectedSignalFromAnotherCan, this);
+    if (field)
+        field->subscribe(CanField::garbageCollectedSignal, this);
 
     // Create self messages for retries while waiting for ACK from cans
     sendCanTimer = new cMessage("sendCanTimer");
     sendAnotherCanTimer = new cMessage("sendAnotherCanTimer");
+    retryWheelTimers[GATE_CAN].client = retryWheelTimers[GATE_ANOTHER_CAN].client = this;
+    retryWheelTimers[GATE_CAN].context = sendCanTimer;
+    retryWheelTimers[GATE_ANOTHER_CAN].context = sendAnotherCanTimer;
 
 
     // Create initial text figures, and render
@@ -111,19 +292,37 @@ void HostNode::initialize(){
 }
 
 void HostNode::handleMessage(cMessage *msg){
+    if (handleLinkEvent(msg)) return; // Transmit queue, telemetry
 
-    // For scheduling new messages if can msgs fail
-    if (msg == sendCanTimer) {
-        handleSendTimer(msg, inRangeOfCan, canAcked, atWaypointCan, "Can", 0, GarbageCollectionSystem::FAST_SEND_TO_CAN, GarbageCollectionSystem::SLOW_SEND_TO_CAN);
+    if (msg == sendCanTimer || msg == sendAnotherCanTimer) {
+        retryTimerFired(msg);
         return;
     }
 
-    // For scheduling new messages if anotherCan msgs fail
-    if (msg == sendAnotherCanTimer) {
-        handleSendTimer(msg, inRangeOfAnotherCan, anotherCanAcked, atWaypointAnotherCan, "AnotherCan", 1, GarbageCollectionSystem::FAST_SEND_TO_ANOTHER_CAN, GarbageCollectionSystem::SLOW_SEND_TO_ANOTHER_CAN);
+    // Replies are matched against the in-flight table instead of the FSM state, beacons decide their can directly
+    if (trackDecisions) {
+        noteAnswer(msg);
+        handlePipelinedMessage(msg);
+        delete msg;
         return;
     }
 
+    // Sequential mode only acts on the answer of the can it is waiting at, which then goes through the usual handlers as YES/NO
+    if (system->getMsgId(msg) == MSG_13_DISCOVERY_REPLY) {
+        int canIndex = discoveryReplyCan(msg);
+        bool full = msg->par("full");
+        simtime_t queryTime = msg->getTimestamp();
+        delete msg;
+
+        if (canIndex < 0 || system->currentFsm->getState() != canState(canIndex))
+            return;
+
+        if (canIndex == GATE_CAN) msg = system->createMessage(full ? MSG_3_YES : MSG_2_NO);
+        else msg = system->createMessage(full ? MSG_6_YES : MSG_5_NO);
+        msg->setTimestamp(queryTime);
+    }
+    noteAnswer(msg);
+
     // Want to handle messages differently depending on which config is active, related handlers are called
     switch(system->fsmType){
         case GarbageCollectionSystem::FAST: handleFastMessageTransmissions(msg); break;
@@ -135,29 +334,34 @@ void HostNode::handleMessage(cMessage *msg){
 }
 
 bool HostNode::isInRangeOf(Node* target) {
-    // Simple method for checking if coverage circles are overlapping a given target, only used on Can and AnotherCan since Cloud is all encompassing
-
-    // Host must have mobility, otherwise no need to check
-    if (!mobility) return false;
-
-    // Acquire the hosts position
-    auto posHost = mobility->getCurrentPosition();
-
-    // Get target position
-    double xOther, yOther, rangeOther;
-
-    // Extract the targets position, and coverage range
-    xOther = target->par("x");
-    yOther = target->par("y");
-    rangeOther = target->par("range");
-
-    // Get the pos diff and use pythagoras
-    double dx = posHost.x - xOther;
-    double dy = posHost.y - yOther;
-    double distance = std::sqrt(dx*dx + dy*dy);
+    // Coverage circles overlap, from the last scan of the cans, only used on Can and AnotherCan since Cloud is all encompassing
+    int slot = system->getCanSlot(target);
+    if (field) {
+        int canIndex = target == system->canNode ? GATE_CAN : GATE_ANOTHER_CAN;
+        slot = routeFieldCan(canIndex) >= 0 ? fieldSlot[canIndex] : -1;
+    }
+    return mobility && slot >= 0 && slot < (int)canScan.inRange.size() && canScan.inRange[slot];
+}
 
-    // circles overlap if distance <= sum of ranges
-    return distance <= (this->range + rangeOther);
+// Field can of a stop, the nearest one to its waypoint that covers it. -1 until the field has placed its cans
+int HostNode::routeFieldCan(int canIndex){
+    if (fieldCan[canIndex] >= 0 || field->getFirstSlot() < 0)
+        return fieldCan[canIndex];
+
+    const Coord& waypoint = canIndex == GATE_CAN ? waypointCan : waypointAnotherCan;
+    PositionStore::CanScan scan;
+    system->getPositions().scanCans(waypoint.x, waypoint.y, range, system->fastCellularLink->getPropSpeed(), scan);
+
+    int nearest = -1;
+    for (int slot = field->getFirstSlot(); slot < field->getFirstSlot() + field->getNumCans(); slot++)
+        if (nearest < 0 || scan.distance[slot] < scan.distance[nearest])
+            nearest = slot;
+    if (nearest < 0 || !scan.inRange[nearest])
+        throw cRuntimeError("No can of the field covers the waypoint at (%.0f, %.0f)", waypoint.x, waypoint.y);
+
+    fieldSlot[canIndex] = nearest;
+    fieldCan[canIndex] = nearest - field->getFirstSlot();
+    return fieldCan[canIndex];
 }
 
 void HostNode::receiveSignal(cComponent *source, simsignal_t signalID, cObject *obj, cObject *details){
@@ -174,17 +378,32 @@ void HostNode::receiveSignal(cComponent *source, simsignal_t signalID, cObject *
             updateCoverageCirclePlacement(pos);
             updateStatusTextPlacement(pos);
 
-            // Update coords for module
-            x = pos.x;
-            y = pos.y;
+            // Update coords for module, then one pass over all cans in the position store
+            system->getPositions().setPosition(positionIndex, pos.x, pos.y);
+            system->getPositions().scanCans(pos.x, pos.y, range, system->fastCellularLink->getPropSpeed(), canScan);
 
             // Check if we are in range of any can
             bool nowInRangeCan = isInRangeOf(system->canNode);
             bool nowInRangeAnotherCan = isInRangeOf(system->anotherCanNode);
 
-            // Check that host is at waypoint with some margin
+            // Check that host is at waypoint with some margin, the stop starts when the host gets there. Updates at the
+            // same position after a new leg was set do not count as an arrival
+            bool wasAtWaypoint = atWaypointCan || atWaypointAnotherCan;
             atWaypointCan = mobility->getCurrentPosition().distance(waypointCan) <= 1;
             atWaypointAnotherCan = mobility->getCurrentPosition().distance(waypointAnotherCan) <= 1;
+            if ((atWaypointCan || atWaypointAnotherCan) && !wasAtWaypoint)
+                waypointArrival = simTime();
+
+            // A look-ahead decision was ready before the stop, leave right away
+            if (pendingLeg && (strcmp(pendingLeg, "2") == 0 ? atWaypointCan : atWaypointAnotherCan)) {
+                const char *legId = pendingLeg;
+                pendingLeg = nullptr;
+                readyOnArrival++;
+                startLeg(legId);
+            }
+
+            if (nowInRangeCan && !inRangeOfCan) visits[GATE_CAN].coverageEntry = simTime();
+            if (nowInRangeAnotherCan && !inRangeOfAnotherCan) visits[GATE_ANOTHER_CAN].coverageEntry = simTime();
 
             // Want to set some range state vars, cancels message scheduling if we have passed a can and we are finished with it
             updateRangeState(nowInRangeCan, inRangeOfCan, sendCanTimer, "Can");
@@ -194,34 +413,67 @@ void HostNode::receiveSignal(cComponent *source, simsignal_t signalID, cObject *
             if(!nowInRangeCan && !nowInRangeAnotherCan){
                 oval->setLineColor(cFigure::BLACK);
             }
+
+            // Decisions may already be complete when the host reaches a waypoint
+            if (trackDecisions)
+                advanceRoute();
+            if (lookAheadQueries)
+                lookAhead();
         }
 }
 
 void HostNode::updateCoverageCirclePlacement(Coord& pos){
-    oval->setBounds(cFigure::Rectangle(pos.x - range, pos.y - range, range*2, range*2));
+    system->markBoundsDirty(oval, cFigure::Rectangle(pos.x - range, pos.y - range, range*2, range*2));
 }
 
 void HostNode::updateStatusTextPlacement(Coord& pos){
     // Re-render status text position on Host movement
     if (statusText) {
-        statusText->setPosition(cFigure::Point(pos.x - 500, pos.y - 100));
+        system->markPositionDirty(statusText, cFigure::Point(pos.x - 500, pos.y - 100));
     }
 }
 
 void HostNode::receiveSignal(cComponent *source, simsignal_t signalID, bool value, cObject *details){
+    canCollected(signalID == Node::garbageCollectedSignalFromCan ? GATE_CAN : GATE_ANOTHER_CAN);
+}
+
+void HostNode::receiveSignal(cComponent *source, simsignal_t signalID, intval_t value, cObject *details){
+    Enter_Method_Silent();
+
+    // Only FAST waits for the can, a SLOW host has the cloud's OK for the same collection
+    if (system->fsmType != GarbageCollectionSystem::FAST)
+        return;
+    for (int canIndex : {GATE_CAN, GATE_ANOTHER_CAN})
+        if (fieldCan[canIndex] == value)
+            canCollected(canIndex);
+}
+
+void HostNode::canCollected(int canIndex){
 
     // Only triggers on the fast config, will set an appropriate leg based on emitted signal
     // This signal handler removed the necessity of a handleFastFsmTransistion method, as we have for EMPTY and SLOW config
-    if(signalID == Node::garbageCollectedSignalFromCan){
-            cXMLElement *movementLeg = root->getElementById("2");
-            mobility->setLeg(movementLeg);
-            FSM_Goto(*system->currentFsm, system->FAST_SEND_TO_ANOTHER_CAN);
+    // A lost reply makes the host ask again, so a can may forward a second collect request and signal twice. Only the first signal counts
+    if (trackDecisions) {
+        markDecided(canIndex);
+        advanceRoute();
+        return;
+    }
+
+    if (hybridPaths) {
+        hybridCollected(canIndex);
+        return;
+    }
+
+    if(canIndex == GATE_CAN && system->currentFsm->getState() == GarbageCollectionSystem::FAST_SEND_TO_CAN){
+            visitCompleted(system->canNode);
+            startLeg("2");
+            system->gotoState(this, system->FAST_SEND_TO_ANOTHER_CAN);
         }
 
-    if(signalID == Node::garbageCollectedSignalFromAnotherCan){
-        cXMLElement *movementLeg = root->getElementById("3");
-        mobility->setLeg(movementLeg);
-        FSM_Goto(*system->currentFsm, system->FAST_EXIT);
+    if(canIndex == GATE_ANOTHER_CAN && system->currentFsm->getState() == GarbageCollectionSystem::FAST_SEND_TO_ANOTHER_CAN){
+        visitCompleted(system->anotherCanNode);
+        startLeg("3");
+        system->gotoState(this, system->FAST_EXIT);
     }
 }
 
@@ -231,6 +483,8 @@ void HostNode::handleSlowFsmTransitions(cMessage *msg){
         {
             // When this state is entered, we want to send a collect message to the cloud
             cMessage *req = system->createMessage(MSG_7_COLLECT_GARBAGE);
+            if (field) req->addPar("can") = (long)fieldCan[GATE_CAN];
+            cloudRequestSent = simTime();
 
             // Compute the dynamic delay and update global statistics
             simtime_t cloudDelay = system->slowCellularLink->computeDynamicDelay(this, system->cloudNode);
@@ -238,7 +492,7 @@ void HostNode::handleSlowFsmTransitions(cMessage *msg){
             GlobalDelays.slow_others_to_cloud += cloudDelay.dbl();
 
             // send the message and handle stat updates
-            send(req, "gate$o", GATE_CLOUD);
+            sendMessage(req, GATE_CLOUD);
             sendHostSlow++;
             updateStatusText();
             break;
@@ -247,6 +501,8 @@ void HostNode::handleSlowFsmTransitions(cMessage *msg){
         {
             // send the final collect msg to cloud
             cMessage *req = system->createMessage(MSG_9_COLLECT_GARBAGE);
+            if (field) req->addPar("can") = (long)fieldCan[GATE_ANOTHER_CAN];
+            cloudRequestSent = simTime();
 
             // Compute dynamic delay and update global statistics
             simtime_t cloudDelay = system->slowCellularLink->computeDynamicDelay(this, system->cloudNode);
@@ -254,7 +510,7 @@ void HostNode::handleSlowFsmTransitions(cMessage *msg){
             GlobalDelays.slow_others_to_cloud += cloudDelay.dbl();
 
             // send the message and handle stat updates
-            send(req, "gate$o", GATE_CLOUD);
+            sendMessage(req, GATE_CLOUD);
             sendHostSlow++;
             updateStatusText();
             break;
@@ -269,28 +525,42 @@ void HostNode::handleSlowMessageTransmissions(cMessage *msg){
     // Handle received message based on the msgId
     switch(msgId){
         // ACK from cans have beet retrieved, cancle rescheduling of self mesasges
-        case MSG_3_YES: ackReceived(canAcked, sendCanTimer, system->SLOW_SEND_TO_CAN_CLOUD, rcvdHostFast); break;
-        case MSG_6_YES: ackReceived(anotherCanAcked, sendAnotherCanTimer, system->SLOW_SEND_TO_ANOTHER_CAN_CLOUD, rcvdHostFast); break;
+        case MSG_3_YES:
+            if (!hybridAnswer(msg, GATE_CAN))
+                ackReceived(canAcked, sendCanTimer, system->SLOW_SEND_TO_CAN_CLOUD, rcvdHostFast);
+            break;
+        case MSG_6_YES:
+            if (!hybridAnswer(msg, GATE_ANOTHER_CAN))
+                ackReceived(anotherCanAcked, sendAnotherCanTimer, system->SLOW_SEND_TO_ANOTHER_CAN_CLOUD, rcvdHostFast);
+            break;
 
         case MSG_8_OK:
         {
+            if (hybridPaths) {
+                cloudRoundTrip.update(SIMTIME_DBL(simTime() - cloudRequestSent), pathEwmaAlpha);
+                cloudCollects++;
+            }
             // Received confirmation from cloud, increment status text, set the next leg to traverse and goto next state
             rcvdHostSlow++;
             updateStatusText();
-            cXMLElement *movementLeg = root->getElementById("2");
-            mobility->setLeg(movementLeg);
-            FSM_Goto(*system->currentFsm, GarbageCollectionSystem::SLOW_SEND_TO_ANOTHER_CAN);
+            visitCompleted(system->canNode);
+            startLeg("2");
+            system->gotoState(this, GarbageCollectionSystem::SLOW_SEND_TO_ANOTHER_CAN);
             break;
         }
 
         case MSG_10_OK:
         {
+            if (hybridPaths) {
+                cloudRoundTrip.update(SIMTIME_DBL(simTime() - cloudRequestSent), pathEwmaAlpha);
+                cloudCollects++;
+            }
             // Received confirmation from cloud, increment status text, set the final leg to traverse and enter final state
             rcvdHostSlow++;
             updateStatusText();
-            FSM_Goto(*system->currentFsm, GarbageCollectionSystem::SLOW_EXIT);
-            cXMLElement *movementLeg = root->getElementById("3");
-            mobility->setLeg(movementLeg);
+            visitCompleted(system->anotherCanNode);
+            system->gotoState(this, GarbageCollectionSystem::SLOW_EXIT);
+            startLeg("3");
             break;
 
         }
@@ -306,20 +576,22 @@ void HostNode::handleFastMessageTransmissions(cMessage *msg){
     switch(msgId){
     case MSG_3_YES:
         {
-            // Received confirmation from Can
+            // Received confirmation from Can, a late duplicate of a retried query is not counted again
+            if (canAcked) break;
             rcvdHostFast++;
             updateStatusText();
             canAcked = true;
-            cancelEvent(sendCanTimer);
+            cancelRetryTimer(sendCanTimer);
             break;
         }
     case MSG_6_YES:
         {
             // Received confirmation from AnotherCan
+            if (anotherCanAcked) break;
             rcvdHostFast++;
             updateStatusText();
             anotherCanAcked = true;
-            cancelEvent(sendAnotherCanTimer);
+            cancelRetryTimer(sendAnotherCanTimer);
             break;
         }
     }
@@ -330,14 +602,12 @@ void HostNode::handleEmptyFsmTransitions(cMessage *msg){
     FSM_Switch(*system->currentFsm){
         case FSM_Enter(GarbageCollectionSystem::EMPTY_SEND_TO_ANOTHER_CAN):
         {
-           cXMLElement *movementLeg = root->getElementById("2");
-           mobility->setLeg(movementLeg);
+           startLeg("2");
            break;
         }
         case FSM_Enter(GarbageCollectionSystem::EMPTY_EXIT):
         {
-            cXMLElement *movementLeg = root->getElementById("3");
-            mobility->setLeg(movementLeg);
+            startLeg("3");
             break;
         }
     }
@@ -348,8 +618,14 @@ void HostNode::handleEmptyMessageTransmissions(cMessage *msg){
     // Upon answer from can, mark them as acked, then cancel self-message
     int msgId = system->getMsgId(msg);
     switch(msgId){
-        case MSG_2_NO: ackReceived(canAcked, sendCanTimer, GarbageCollectionSystem::EMPTY_SEND_TO_ANOTHER_CAN, rcvdHostFast); break;
-        case MSG_5_NO: ackReceived(anotherCanAcked, sendAnotherCanTimer, GarbageCollectionSystem::EMPTY_EXIT, rcvdHostFast); break;
+        case MSG_2_NO:
+            if (!canAcked) visitCompleted(system->canNode);
+            ackReceived(canAcked, sendCanTimer, GarbageCollectionSystem::EMPTY_SEND_TO_ANOTHER_CAN, rcvdHostFast);
+            break;
+        case MSG_5_NO:
+            if (!anotherCanAcked) visitCompleted(system->anotherCanNode);
+            ackReceived(anotherCanAcked, sendAnotherCanTimer, GarbageCollectionSystem::EMPTY_EXIT, rcvdHostFast);
+            break;
     }
 }
 
@@ -362,15 +638,82 @@ void HostNode::handleSendTimer(cMessage *msg,
     if (acked || !inRange)
         return;
 
+    // Pipelined, ask every can in range without waiting for the waypoint or the FSM, bounded by the in-flight table
+    if (pipelineQueries) {
+        // A query unanswered for a retry interval counts as lost and frees its slot, a late reply is then stale
+        for (auto it = inFlight.begin(); it != inFlight.end();) {
+            bool expired = (it->second.canIndex == gateIndex || it->second.canIndex < 0) && simTime() - it->second.sentAt >= GarbageCollectionSystem::HOST_RETRY_INTERVAL;
+            if (expired) timedOutQueries++;
+            it = expired ? inFlight.erase(it) : std::next(it);
+        }
+        if ((int)inFlight.size() < maxInFlight)
+            sendCanQuery(gateIndex);
+        armRetryTimer(msg);
+        return;
+    }
+
     // Are we in a state where a send should be done?
     bool stateOk = system->currentFsm &&
         (system->currentFsm->getState() == sendState || system->currentFsm->getState() == altSendState);
 
-    // Are we in a sendable state, and is the waypoint reached?
-    if (stateOk && atWp) {
-        // gateIndex == 0 means we are sending to can, else (1) we send to  anotherCan
-        cMessage *req = (gateIndex == 0) ? system->createMessage(MSG_1_IS_CAN_FULL) : system->createMessage(MSG_4_IS_CAN_FULL);
+    // Are we in a sendable state, and is the waypoint reached or close enough to ask ahead?
+    if (stateOk && (atWp || lookingAhead(gateIndex))) {
+        sendCanQuery(gateIndex);
+    }
 
+    // Re-arm regardless of atWp so we don't drop the timer while approaching the waypoint
+    armRetryTimer(msg);
+}
+
+// For scheduling new messages if can or anotherCan msgs fail
+void HostNode::retryTimerFired(cMessage *timer){
+    if (timer == sendCanTimer)
+        handleSendTimer(timer, inRangeOfCan, canAcked, atWaypointCan, "Can", 0, GarbageCollectionSystem::FAST_SEND_TO_CAN, GarbageCollectionSystem::SLOW_SEND_TO_CAN);
+    else
+        handleSendTimer(timer, inRangeOfAnotherCan, anotherCanAcked, atWaypointAnotherCan, "AnotherCan", 1, GarbageCollectionSystem::FAST_SEND_TO_ANOTHER_CAN, GarbageCollectionSystem::SLOW_SEND_TO_ANOTHER_CAN);
+}
+
+// Called from the system's wheel tick, every host timer of the tick fires in that one event
+void HostNode::wheelTimerFired(WheelTimer *timer){
+    Enter_Method_Silent();
+    system->traceEvent(this, static_cast<cMessage *>(timer->context)->getName());
+    retryTimerFired(static_cast<cMessage *>(timer->context));
+}
+
+void HostNode::armRetryTimer(cMessage *timer){
+    if (system->isTimerWheelEnabled())
+        system->scheduleTimer(&retryWheelTimers[timer == sendCanTimer ? GATE_CAN : GATE_ANOTHER_CAN], simTime() + GarbageCollectionSystem::HOST_RETRY_INTERVAL);
+    else
+        scheduleAt(simTime() + GarbageCollectionSystem::HOST_RETRY_INTERVAL, timer);
+}
+
+void HostNode::cancelRetryTimer(cMessage *timer){
+    if (system->isTimerWheelEnabled())
+        system->cancelTimer(&retryWheelTimers[timer == sendCanTimer ? GATE_CAN : GATE_ANOTHER_CAN]);
+    else
+        cancelEvent(timer);
+}
+
+bool HostNode::isRetryTimerArmed(cMessage *timer){
+    if (system->isTimerWheelEnabled())
+        return retryWheelTimers[timer == sendCanTimer ? GATE_CAN : GATE_ANOTHER_CAN].scheduled;
+    return timer->isScheduled();
+}
+
+void HostNode::sendCanQuery(int gateIndex){
+    if (system->broadcastDiscovery) {
+        sendDiscovery(gateIndex);
+        return;
+    }
+
+    // gateIndex == 0 means we are sending to can, else (1) we send to  anotherCan
+    cMessage *req = (gateIndex == 0) ? system->createMessage(MSG_1_IS_CAN_FULL) : system->createMessage(MSG_4_IS_CAN_FULL);
+
+    // A can of the field is not a Node, the field link adds no modeled delay
+    if (field) {
+        req->addPar("can") = (long)fieldCan[gateIndex];
+    }
+    else {
         // Figure out which node to calculate delay to
         Node *nodeToCalculateDelayFor = gateIndex == 0 ? system->canNode : system->anotherCanNode;
         simtime_t delay = system->fastCellularLink->computeDynamicDelay(this, nodeToCalculateDelayFor);
@@ -382,15 +725,291 @@ void HostNode::handleSendTimer(cMessage *msg,
         }else{
             GlobalDelays.connection_from_others_to_another_can += delay.dbl();
         }
+    }
 
-        // Send and update stats
-        send(req, "gate$o", gateIndex);
-        sendHostFast++;
-        updateStatusText();
+    if (pipelineQueries) {
+        req->addPar("seq") = nextSeq;
+        inFlight[nextSeq++] = InFlightQuery{gateIndex, simTime()};
+    }
+    if (hybridPaths && chooseFogPath(gateIndex)) {
+        req->addPar("viaFog") = true;
+        lastFogQuery[gateIndex] = simTime();
     }
+    req->setTimestamp();
+    noteQuerySent(gateIndex);
 
-    // Re-arm regardless of atWp so we don't drop the timer while approaching the waypoint
-    scheduleAt(simTime() + 1, msg);
+    // Send and update stats
+    sendMessage(req, field ? fieldGate : gateIndex);
+    sendHostFast++;
+    updateStatusText();
+}
+
+// One frame to every can in coverage, skipped if the other can's timer broadcast within the retry interval
+void HostNode::sendDiscovery(int gateIndex){
+    if (lastDiscovery >= SIMTIME_ZERO && simTime() - lastDiscovery < GarbageCollectionSystem::HOST_RETRY_INTERVAL)
+        return;
+    lastDiscovery = simTime();
+
+    cMessage *req = system->createMessage(MSG_12_DISCOVER);
+    if (pipelineQueries) {
+        req->addPar("seq") = nextSeq;
+        inFlight[nextSeq++] = InFlightQuery{-1, simTime()};
+    }
+    req->setTimestamp();
+
+    // Sequential mode only uses the answer of the can it waits at
+    if (!trackDecisions) noteQuerySent(gateIndex);
+    else {
+        if (inRangeOfCan) noteQuerySent(GATE_CAN);
+        if (inRangeOfAnotherCan) noteQuerySent(GATE_ANOTHER_CAN);
+    }
+
+    sendMessage(req, GATE_MEDIUM);
+    sendHostFast++;
+    discoveriesSent++;
+    updateStatusText();
+}
+
+int HostNode::discoveryReplyCan(cMessage *msg){
+    int sender = (int)msg->par("sender");
+    if (sender == system->canNode->getId()) return GATE_CAN;
+    if (sender == system->anotherCanNode->getId()) return GATE_ANOTHER_CAN;
+    return -1;
+}
+
+void HostNode::handlePipelinedMessage(cMessage *msg){
+    // Pushed by a can, no query to match
+    if (system->getMsgId(msg) == MSG_14_BEACON) {
+        beaconsReceived++;
+        canAnswered(msg->getArrivalGate()->getIndex(), msg->par("full"));
+        advanceRoute();
+        return;
+    }
+
+    long seq = msg->hasPar("seq") ? (long)msg->par("seq") : -1;
+    auto it = inFlight.find(seq);
+    if (it == inFlight.end()) {
+        staleReplies++; // Answer to a query we retried, or the can was decided meanwhile
+        return;
+    }
+    queryLatency.collect(simTime() - it->second.sentAt);
+
+    // A broadcast stays in the table until it expires, every can in coverage may answer it
+    if (system->getMsgId(msg) == MSG_13_DISCOVERY_REPLY) {
+        int canIndex = discoveryReplyCan(msg);
+        if (canIndex >= 0)
+            canAnswered(canIndex, msg->par("full"));
+        advanceRoute();
+        return;
+    }
+
+    int canIndex = it->second.canIndex;
+    inFlight.erase(it);
+
+    switch(system->getMsgId(msg)){
+        case MSG_3_YES:
+        case MSG_6_YES: canAnswered(canIndex, true); break;
+        case MSG_2_NO:
+        case MSG_5_NO: canAnswered(canIndex, false); break;
+        case MSG_8_OK:
+        case MSG_10_OK:
+        {
+            rcvdHostSlow++;
+            updateStatusText();
+            markDecided(canIndex);
+            break;
+        }
+    }
+
+    advanceRoute();
+}
+
+// YES or NO from a can, FAST completes on the can's signal, SLOW asks the cloud itself, EMPTY is done
+void HostNode::canAnswered(int canIndex, bool full){
+    bool &acked = canIndex == GATE_CAN ? canAcked : anotherCanAcked;
+    if (acked) return;
+    acked = true;
+    rcvdHostFast++;
+    updateStatusText();
+    cancelRetryTimer(canIndex == GATE_CAN ? sendCanTimer : sendAnotherCanTimer);
+
+    if (!full)
+        markDecided(canIndex);
+    else if (system->fsmType == GarbageCollectionSystem::SLOW)
+        sendCloudCollect(canIndex);
+}
+
+// SLOW decision, the host forwards the collect request to the cloud over the cellular link
+void HostNode::sendCloudCollect(int canIndex){
+    cMessage *req = system->createMessage(canIndex == GATE_CAN ? MSG_7_COLLECT_GARBAGE : MSG_9_COLLECT_GARBAGE);
+    if (field) req->addPar("can") = (long)fieldCan[canIndex];
+    req->addPar("seq") = nextSeq;
+    inFlight[nextSeq++] = InFlightQuery{canIndex, simTime()};
+
+    simtime_t cloudDelay = system->slowCellularLink->computeDynamicDelay(this, system->cloudNode);
+    GlobalDelays.slow_smartphone_to_others += cloudDelay.dbl();
+    GlobalDelays.slow_others_to_cloud += cloudDelay.dbl();
+
+    sendMessage(req, GATE_CLOUD);
+    sendHostSlow++;
+    updateStatusText();
+}
+
+void HostNode::markDecided(int canIndex){
+    if (decided[canIndex]) return;
+    decided[canIndex] = true;
+    visitCompleted(canIndex == GATE_CAN ? system->canNode : system->anotherCanNode);
+
+    // Replies still in flight for this can are no longer needed
+    for (auto it = inFlight.begin(); it != inFlight.end();)
+        it = it->second.canIndex == canIndex ? inFlight.erase(it) : std::next(it);
+}
+
+// Leaves a waypoint once its can is decided, the FSM follows the legs so the rest of the system sees the usual states
+void HostNode::advanceRoute(){
+    if (system->currentFsm->getState() == canState(GATE_CAN) && decided[GATE_CAN] && atWaypointCan) {
+        startLeg("2");
+        system->gotoState(this, canState(GATE_ANOTHER_CAN));
+    }
+
+    if (system->currentFsm->getState() == canState(GATE_ANOTHER_CAN) && decided[GATE_ANOTHER_CAN] && atWaypointAnotherCan) {
+        startLeg("3");
+        system->gotoState(this, exitState());
+    }
+}
+
+int HostNode::canState(int canIndex){
+    switch (system->fsmType) {
+        case GarbageCollectionSystem::FAST:
+            return canIndex == GATE_CAN ? GarbageCollectionSystem::FAST_SEND_TO_CAN : GarbageCollectionSystem::FAST_SEND_TO_ANOTHER_CAN;
+        case GarbageCollectionSystem::SLOW:
+            return canIndex == GATE_CAN ? GarbageCollectionSystem::SLOW_SEND_TO_CAN : GarbageCollectionSystem::SLOW_SEND_TO_ANOTHER_CAN;
+        default:
+            return canIndex == GATE_CAN ? GarbageCollectionSystem::EMPTY_SEND_TO_CAN : GarbageCollectionSystem::EMPTY_SEND_TO_ANOTHER_CAN;
+    }
+}
+
+int HostNode::exitState(){
+    switch (system->fsmType) {
+        case GarbageCollectionSystem::FAST: return GarbageCollectionSystem::FAST_EXIT;
+        case GarbageCollectionSystem::SLOW: return GarbageCollectionSystem::SLOW_EXIT;
+        default: return GarbageCollectionSystem::EMPTY_EXIT;
+    }
+}
+
+void HostNode::startLeg(const char *legId){
+    int canIndex = strcmp(legId, "2") == 0 ? GATE_CAN : GATE_ANOTHER_CAN;
+
+    // Decided while still approaching, the truck stops at the can before it takes the next leg
+    if (lookAheadQueries && !(canIndex == GATE_CAN ? atWaypointCan : atWaypointAnotherCan)) {
+        pendingLeg = legId;
+        return;
+    }
+
+    recordVisitPhases(canIndex);
+
+    if (waypointArrival >= SIMTIME_ZERO) {
+        waitAtWaypoint.collect(simTime() - waypointArrival);
+        dwellTime[canIndex] = simTime() - waypointArrival;
+        waypointArrival = -1;
+    }
+    if (strcmp(legId, "3") == 0)
+        lastCanDeparture = simTime();
+
+    system->traceEvent(this, std::string("leg ") + legId);
+    cXMLElement *movementLeg = root->getElementById(legId);
+    mobility->setLeg(movementLeg);
+}
+
+void HostNode::noteQuerySent(int canIndex){
+    lastQuerySent[canIndex] = simTime();
+    if (visits[canIndex].firstQuery < SIMTIME_ZERO)
+        visits[canIndex].firstQuery = simTime();
+}
+
+// First YES/NO, discovery reply or beacon about a can, later ones are duplicates for the timeline
+void HostNode::noteAnswer(cMessage *msg){
+    int canIndex = -1;
+    switch (system->getMsgId(msg)) {
+        case MSG_2_NO:
+        case MSG_3_YES: canIndex = GATE_CAN; break;
+        case MSG_5_NO:
+        case MSG_6_YES: canIndex = GATE_ANOTHER_CAN; break;
+        case MSG_13_DISCOVERY_REPLY: canIndex = discoveryReplyCan(msg); break;
+        case MSG_14_BEACON: canIndex = msg->getArrivalGate()->getIndex(); break;
+    }
+    if (canIndex < 0 || visits[canIndex].answerReceived >= SIMTIME_ZERO)
+        return;
+
+    visits[canIndex].answeredQuery = msg->getTimestamp();
+    visits[canIndex].answerReceived = simTime();
+}
+
+// Splits the visit at the recorded instants, a missing instant (no query with beacons, the cloud OK before the
+// can's answer with a cached authorization) makes its phase zero so the phases still add up to the total
+void HostNode::recordVisitPhases(int canIndex){
+    const VisitTimeline& visit = visits[canIndex];
+    simtime_t departure = simTime();
+    simtime_t entry = visit.coverageEntry >= SIMTIME_ZERO ? visit.coverageEntry : departure;
+
+    simtime_t instants[] = {visit.firstQuery >= SIMTIME_ZERO ? visit.firstQuery : visit.answeredQuery,
+                            visit.answeredQuery, visit.answerReceived, visit.decided, departure};
+    simtime_t previous = entry;
+    for (int phase = PHASE_WAIT_FOR_WAYPOINT; phase <= PHASE_TO_DEPARTURE; phase++) {
+        simtime_t instant = instants[phase] >= SIMTIME_ZERO ? std::min(std::max(instants[phase], previous), departure) : previous;
+        phaseHistograms[phase].collect(instant - previous);
+        previous = instant;
+    }
+    phaseHistograms[PHASE_TOTAL].collect(departure - entry);
+}
+
+void HostNode::finish(){
+    recordScalar("messagesSent", sendHostFast + sendHostSlow);
+    if (lastCanDeparture >= SIMTIME_ZERO)
+        recordScalar("lastCanDeparture", lastCanDeparture, "s");
+    if (waitAtWaypoint.getCount() > 0)
+        waitAtWaypoint.record();
+    if (system->broadcastDiscovery)
+        recordScalar("discoveriesSent", discoveriesSent);
+    if (system->beaconMode != GarbageCollectionSystem::BEACON_NONE)
+        recordScalar("beaconsReceived", beaconsReceived);
+    if (timeToDecision.getCount() > 0)
+        timeToDecision.record();
+    if (collectLatency.getCount() > 0)
+        collectLatency.record();
+    if (dwellTime[GATE_CAN] >= SIMTIME_ZERO)
+        recordScalar("canDwellTime", dwellTime[GATE_CAN], "s");
+    if (dwellTime[GATE_ANOTHER_CAN] >= SIMTIME_ZERO)
+        recordScalar("anotherCanDwellTime", dwellTime[GATE_ANOTHER_CAN], "s");
+    if (lookAheadQueries) {
+        recordScalar("queriesAhead", queriesAhead);
+        recordScalar("decisionsReadyOnArrival", readyOnArrival);
+        recordScalar("lookAheadLead", decisionTime.mean, "s");
+    }
+    if (hybridPaths) {
+        recordScalar("fogCollects", fogCollects);
+        recordScalar("cloudCollects", cloudCollects);
+        recordScalar("pathProbes", pathProbes);
+        recordScalar("fogCompletionEstimate", fogCompletion.mean, "s");
+        recordScalar("cloudCompletionEstimate", queryRoundTrip.mean + cloudRoundTrip.mean, "s");
+    }
+
+    // Phase histograms, and the phase with the largest mean as the first optimization target
+    int largest = -1;
+    for (int phase = 0; phase < NUM_PHASES; phase++) {
+        if (phaseHistograms[phase].getCount() == 0) continue;
+        phaseHistograms[phase].record();
+        if (phase != PHASE_TOTAL && (largest < 0 || phaseHistograms[phase].getMean() > phaseHistograms[largest].getMean()))
+            largest = phase;
+    }
+    if (largest >= 0)
+        EV << "Largest visit phase: " << phaseHistograms[largest].getName() << ", mean " << phaseHistograms[largest].getMean() << "s\n";
+    if (pipelineQueries) {
+        recordScalar("staleReplies", staleReplies);
+        recordScalar("timedOutQueries", timedOutQueries);
+        if (queryLatency.getCount() > 0)
+            queryLatency.record();
+    }
 }
 
 // A simple update method for re-rendering displayed text
@@ -399,7 +1018,7 @@ void HostNode::updateStatusText() {
     sprintf(buf, "sentHostFast: %d rcvdHostFast: %d sentHostSlow: %d rcvdHostSlow: %d",
             sendHostFast, rcvdHostFast, sendHostSlow, rcvdHostSlow);
     if (statusText) {
-        statusText->setText(buf);
+        system->markTextDirty(statusText, buf);
     }
 }
 
@@ -409,22 +1028,153 @@ void HostNode::updateRangeState(bool nowInRange, bool &prevInRange, cMessage *ti
         // Start self message scheduling when entering range
         prevInRange = true;
         oval->setLineColor(cFigure::GREEN);
-        if (!timer->isScheduled())
-            scheduleAt(simTime() + 1, timer);
+        if (system->beaconMode == GarbageCollectionSystem::BEACON_NONE && !isRetryTimerArmed(timer)) // No polling when the cans push beacons
+            armRetryTimer(timer);
     }
     // Are we no longer in range and have we been in range? (We have passed the can)
     else if (!nowInRange && prevInRange) {
         // Cancel the send timer
         prevInRange = false; // Set to false so if multiple rounds would occur (they wont) scheduling will still work
-        cancelEvent(timer);
+        cancelRetryTimer(timer);
     }
 }
 
 // Ack a rcvd message from can and perform a state transition
 void HostNode::ackReceived(bool &ackedFlag, cMessage *timer, int nextState, int &rcvdCounter){
+    if (ackedFlag) return; // Late duplicate of an answer we already acted on
+
     rcvdCounter++;
     updateStatusText();
     ackedFlag = true;
-    cancelEvent(timer);
-    FSM_Goto(*system->currentFsm, nextState);
+    cancelRetryTimer(timer);
+    system->gotoState(this, nextState);
+}
+
+// The host is done with a can, feed the per-visit statistics
+void HostNode::visitCompleted(Node *can){
+    int canIndex = can == system->canNode ? GATE_CAN : GATE_ANOTHER_CAN;
+    visits[canIndex].decided = simTime();
+    if (visits[canIndex].coverageEntry >= SIMTIME_ZERO)
+        timeToDecision.collect(simTime() - visits[canIndex].coverageEntry);
+    if (system->fsmType != GarbageCollectionSystem::EMPTY && lastQuerySent[canIndex] >= SIMTIME_ZERO)
+        collectLatency.collect(simTime() - lastQuerySent[canIndex]);
+    if (lookAheadQueries && visits[canIndex].firstQuery >= SIMTIME_ZERO)
+        decisionTime.update(SIMTIME_DBL(simTime() - visits[canIndex].firstQuery), pathEwmaAlpha);
+}
+
+// Fog completes when the can's forwarded request is authorized, cloud needs the can's answer and then the host's own round trip.
+// With pathProbeProbability the other path is taken instead, so a path that lost once can win back when its delays drop
+bool HostNode::chooseFogPath(int canIndex){
+    if (!pathPriorsSet)
+        seedPathEstimates(canIndex);
+    bool fog = fogCompletion.mean <= queryRoundTrip.mean + cloudRoundTrip.mean;
+    if (pathProbeProbability > 0 && uniform(0, 1) < pathProbeProbability) {
+        pathProbes++;
+        return !fog;
+    }
+    return fog;
+}
+
+// Mean modeled delays of the hops from the can's waypoint, where the host stops to query it, until the first observations
+// replace them. The first query may go out before the waypoint, the seeds must not depend on where
+void HostNode::seedPathEstimates(int canIndex){
+    pathPriorsSet = true;
+    auto hopMean = [](const HopModel& hop) { return hop.baseSec + hop.propagationSec; }; // The jitter is symmetric
+    Node *can = canIndex == GATE_CAN ? system->canNode : system->anotherCanNode;
+    Node *cloud = system->cloudNode;
+    Node *upstream = system->fogUpstreamNode;
+    const Coord& waypoint = canIndex == GATE_CAN ? waypointCan : waypointAnotherCan;
+    double hostToCan = std::hypot(waypoint.x - can->getX(), waypoint.y - can->getY());
+    double canToUpstream = std::hypot(can->getX() - upstream->getX(), can->getY() - upstream->getY());
+    double hostToCloud = std::hypot(waypoint.x - cloud->getX(), waypoint.y - cloud->getY());
+
+    double query = hopMean(system->fastCellularLink->hopModel(hostToCan));
+    double fog = hopMean(system->fastWiFiLink->hopModel(canToUpstream));
+    queryRoundTrip.mean = 2 * query;
+    fogCompletion.mean = query + 2 * fog;
+    cloudRoundTrip.mean = 2 * hopMean(system->slowCellularLink->hopModel(hostToCloud));
+}
+
+// YES in hybrid mode, returns true when the can took the fog path and the host only waits for its collected signal
+bool HostNode::hybridAnswer(cMessage *msg, int canIndex){
+    if (!hybridPaths)
+        return false;
+
+    bool &acked = canIndex == GATE_CAN ? canAcked : anotherCanAcked;
+    if (!acked)
+        queryRoundTrip.update(SIMTIME_DBL(simTime() - msg->getTimestamp()), pathEwmaAlpha);
+    if (!msg->hasPar("viaFog"))
+        return false;
+
+    if (!acked) {
+        rcvdHostFast++;
+        updateStatusText();
+        acked = true;
+        cancelRetryTimer(canIndex == GATE_CAN ? sendCanTimer : sendAnotherCanTimer);
+    }
+    return true;
+}
+
+// Collected signal of a fog path request, may arrive before the can's YES. Later duplicates find the FSM moved on
+void HostNode::hybridCollected(int canIndex){
+    int waitingState = canIndex == GATE_CAN ? GarbageCollectionSystem::SLOW_SEND_TO_CAN : GarbageCollectionSystem::SLOW_SEND_TO_ANOTHER_CAN;
+    if (system->currentFsm->getState() != waitingState || lastFogQuery[canIndex] < SIMTIME_ZERO)
+        return;
+
+    fogCompletion.update(SIMTIME_DBL(simTime() - lastFogQuery[canIndex]), pathEwmaAlpha);
+    fogCollects++;
+
+    // A late answer without the fog flag must not start a cloud request as well
+    bool &acked = canIndex == GATE_CAN ? canAcked : anotherCanAcked;
+    acked = true;
+    cancelRetryTimer(canIndex == GATE_CAN ? sendCanTimer : sendAnotherCanTimer);
+
+    if (canIndex == GATE_CAN) {
+        visitCompleted(system->canNode);
+        startLeg("2");
+        system->gotoState(this, GarbageCollectionSystem::SLOW_SEND_TO_ANOTHER_CAN);
+    }
+    else {
+        visitCompleted(system->anotherCanNode);
+        startLeg("3");
+        system->gotoState(this, GarbageCollectionSystem::SLOW_EXIT);
+    }
+}
+
+// Can of the current FSM state, -1 while the host waits for the cloud or has left the last can
+int HostNode::currentCan(){
+    int state = system->currentFsm->getState();
+    if (state == canState(GATE_CAN))
+        return GATE_CAN;
+    return state == canState(GATE_ANOTHER_CAN) ? GATE_ANOTHER_CAN : -1;
+}
+
+// Straight line to the waypoint at the current speed, the legs run straight into their waypoints
+double HostNode::secondsToWaypoint(int canIndex){
+    double distance = mobility->getCurrentPosition().distance(canIndex == GATE_CAN ? waypointCan : waypointAnotherCan);
+    double speed = mobility->getCurrentVelocity().length();
+    if (distance <= 1)
+        return 0;
+    return speed > 0 ? distance / speed : INFINITY;
+}
+
+bool HostNode::lookingAhead(int canIndex){
+    return lookAheadQueries && !pendingLeg && currentCan() == canIndex && secondsToWaypoint(canIndex) <= decisionTime.mean;
+}
+
+// First query of the can ahead, the retry timer then runs from this query
+void HostNode::lookAhead(){
+    int canIndex = currentCan();
+    if (canIndex < 0 || visits[canIndex].firstQuery >= SIMTIME_ZERO)
+        return;
+    bool inRange = canIndex == GATE_CAN ? inRangeOfCan : inRangeOfAnotherCan;
+    bool acked = canIndex == GATE_CAN ? canAcked : anotherCanAcked;
+    if (!inRange || acked || !lookingAhead(canIndex))
+        return;
+
+    sendCanQuery(canIndex);
+    queriesAhead++;
+    cMessage *timer = canIndex == GATE_CAN ? sendCanTimer : sendAnotherCanTimer;
+    cancelRetryTimer(timer);
+    armRetryTimer(timer);
 }
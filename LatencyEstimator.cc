@@ -0,0 +1,179 @@
+#include "LatencyEstimator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <stdexcept>
+
+// Retry tails below this probability are cut off
+static const double TAIL_EPSILON = 1e-9;
+
+// Shifts are merged on a nanosecond grid
+static long long shiftKey(double sec)
+{
+    return std::llround(sec * 1e9);
+}
+
+double LatencyDistribution::mean() const
+{
+    double coreMean = 0;
+    for (size_t i = 0; i < pmf.size(); i++)
+        coreMean += pmf[i] * (offsetSec + (i + 0.5) * binSec);
+
+    double shiftMean = 0;
+    for (auto& shift : shifts)
+        shiftMean += shift.first * shift.second;
+
+    return coreMean + shiftMean;
+}
+
+// Interpolates linearly inside a bin
+static double coreCdf(const std::vector<double>& cumulative, const std::vector<double>& pmf, double offsetSec, double binSec, double tSec)
+{
+    double x = (tSec - offsetSec) / binSec;
+    if (x <= 0) return 0;
+    size_t index = (size_t)x;
+    if (index >= pmf.size()) return cumulative.back();
+    double below = index == 0 ? 0 : cumulative[index - 1];
+    return below + pmf[index] * (x - index);
+}
+
+double LatencyDistribution::cdf(double tSec) const
+{
+    std::vector<double> cumulative(pmf.size());
+    double sum = 0;
+    for (size_t i = 0; i < pmf.size(); i++)
+        cumulative[i] = sum += pmf[i];
+
+    double result = 0;
+    for (auto& shift : shifts)
+        result += shift.second * coreCdf(cumulative, pmf, offsetSec, binSec, tSec - shift.first);
+    return result;
+}
+
+// Bisection on the CDF, the prefix sums are computed once
+double LatencyDistribution::quantile(double p) const
+{
+    if (pmf.empty() || shifts.empty()) return NAN; // All retry shifts fell below TAIL_EPSILON, no mass left
+
+    std::vector<double> cumulative(pmf.size());
+    double sum = 0;
+    for (size_t i = 0; i < pmf.size(); i++)
+        cumulative[i] = sum += pmf[i];
+
+    double lo = offsetSec, hi = offsetSec + pmf.size() * binSec;
+    double minShift = shifts.front().first, maxShift = shifts.front().first;
+    for (auto& shift : shifts) {
+        minShift = std::min(minShift, shift.first);
+        maxShift = std::max(maxShift, shift.first);
+    }
+    lo += minShift;
+    hi += maxShift;
+
+    for (int i = 0; i < 64; i++) {
+        double mid = (lo + hi) / 2;
+        double value = 0;
+        for (auto& shift : shifts)
+            value += shift.second * coreCdf(cumulative, pmf, offsetSec, binSec, mid - shift.first);
+        if (value < p) lo = mid; else hi = mid;
+    }
+    return hi;
+}
+
+// Spread the mass of U(lo, hi) over the bins it overlaps, negative delays are clamped to zero like in computeDynamicDelay()
+LatencyDistribution LatencyEstimator::hop(const HopModel& model) const
+{
+    double lo = model.baseSec * (1 - model.jitterPercentage) + model.propagationSec;
+    double hi = model.baseSec * (1 + model.jitterPercentage) + model.propagationSec;
+
+    LatencyDistribution dist;
+    dist.binSec = binSec;
+
+    double clampedLo = std::max(lo, 0.0);
+    dist.offsetSec = std::floor(clampedLo / binSec) * binSec;
+
+    // No jitter, all mass in one bin
+    if (hi <= clampedLo) {
+        dist.pmf.assign(1, 1.0);
+        return dist;
+    }
+
+    size_t numBins = (size_t)std::ceil((hi - dist.offsetSec) / binSec);
+    dist.pmf.assign(std::max<size_t>(numBins, 1), 0.0);
+    for (size_t i = 0; i < dist.pmf.size(); i++) {
+        double binLo = dist.offsetSec + i * binSec;
+        double overlap = std::min(binLo + binSec, hi) - std::max(binLo, clampedLo);
+        if (overlap > 0)
+            dist.pmf[i] = overlap / (hi - lo);
+    }
+    // Mass below zero
+    if (lo < 0)
+        dist.pmf[0] += -lo / (hi - lo);
+    return dist;
+}
+
+LatencyDistribution LatencyEstimator::convolve(const LatencyDistribution& a, const LatencyDistribution& b) const
+{
+    LatencyDistribution result;
+    result.binSec = binSec;
+    // Bin i of a plus bin j of b is centred one bin above the summed lower edges, i.e. half a bin into result bin i + j
+    result.offsetSec = a.offsetSec + b.offsetSec + binSec / 2;
+    result.pmf.assign(a.pmf.size() + b.pmf.size() - 1, 0.0);
+    for (size_t i = 0; i < a.pmf.size(); i++) {
+        if (a.pmf[i] == 0) continue;
+        for (size_t j = 0; j < b.pmf.size(); j++)
+            result.pmf[i + j] += a.pmf[i] * b.pmf[j];
+    }
+
+    std::map<long long, std::pair<double, double>> merged;
+    for (auto& sa : a.shifts)
+        for (auto& sb : b.shifts) {
+            auto& entry = merged[shiftKey(sa.first + sb.first)];
+            entry.first = sa.first + sb.first;
+            entry.second += sa.second * sb.second;
+        }
+
+    result.shifts.clear();
+    for (auto& entry : merged)
+        if (entry.second.second > TAIL_EPSILON)
+            result.shifts.push_back(entry.second);
+    return result;
+}
+
+LatencyDistribution LatencyEstimator::chain(const std::vector<HopModel>& hops) const
+{
+    if (hops.empty()) {
+        LatencyDistribution zero;
+        zero.binSec = binSec;
+        zero.pmf.assign(1, 1.0);
+        return zero;
+    }
+
+    LatencyDistribution result = hop(hops.front());
+    for (size_t i = 1; i < hops.size(); i++)
+        result = convolve(result, hop(hops[i]));
+    return result;
+}
+
+// Attempt k (k >= 1) succeeds with probability s * (1 - s)^(k - 1) and costs (fixedRetries + k - 1) retry intervals
+LatencyDistribution LatencyEstimator::withRetries(const LatencyDistribution& attempt, int fixedRetries, double retryIntervalSec, double successProbability) const
+{
+    if (successProbability <= 0)
+        throw std::invalid_argument("LatencyEstimator: an attempt must succeed with a positive probability");
+
+    std::vector<std::pair<double, double>> retries;
+    double remaining = 1;
+    for (int k = 1; remaining > TAIL_EPSILON && k <= 1000; k++) {
+        double probability = remaining * std::min(successProbability, 1.0);
+        retries.push_back({(fixedRetries + k - 1) * retryIntervalSec, probability});
+        remaining -= probability;
+    }
+
+    // The retries only add fixed delays, the pmf of the attempt itself is unchanged
+    LatencyDistribution result = attempt;
+    result.shifts.clear();
+    for (auto& sa : attempt.shifts)
+        for (auto& sb : retries)
+            result.shifts.push_back({sa.first + sb.first, sa.second * sb.second});
+    return result;
+}
@@ -0,0 +1,61 @@
+#ifndef __SMARTGARBAGECOLLECTION_LATENCYESTIMATOR_H_
+#define __SMARTGARBAGECOLLECTION_LATENCYESTIMATOR_H_
+
+#include <vector>
+#include <utility>
+
+/**
+ * One hop of the RealisticDelayChannel delay model,
+ * baseSec * (1 + U(-jitterPercentage, jitterPercentage)) + propagationSec
+ */
+struct HopModel {
+    double baseSec = 0;
+    double jitterPercentage = 0;
+    double propagationSec = 0;
+    double lossProbability = 0; // PER of the hop, used for the expected number of retries
+};
+
+/**
+ * Discretized latency distribution. The summed hop delays are kept as a pmf on a fixed bin grid,
+ * retries are kept as a short list of (fixed delay, probability) shifts applied on top of that pmf,
+ * so a one second retry interval does not blow up the number of bins.
+ */
+class LatencyDistribution
+{
+  public:
+    double offsetSec = 0;                              // Lower edge of the first bin
+    double binSec = 0;                                 // Width of each bin
+    std::vector<double> pmf;                           // Probability mass per bin
+    std::vector<std::pair<double, double>> shifts = {{0, 1}}; // (delay in seconds, probability)
+
+  public:
+    double mean() const;
+    double cdf(double tSec) const;
+    double quantile(double p) const;   // NaN for a distribution without mass
+};
+
+/**
+ * Closed-form latency estimator, convolves per-hop delay distributions instead of simulating them
+ */
+class LatencyEstimator
+{
+  protected:
+    double binSec;
+
+  public:
+    explicit LatencyEstimator(double binSec) : binSec(binSec) {}
+
+    // Uniform distribution of a single hop
+    LatencyDistribution hop(const HopModel& model) const;
+
+    // Distribution of the sum of two independent latencies
+    LatencyDistribution convolve(const LatencyDistribution& a, const LatencyDistribution& b) const;
+
+    // Sum of a sequence of independent hops
+    LatencyDistribution chain(const std::vector<HopModel>& hops) const;
+
+    // Adds fixedRetries deterministic retries, then geometric retries where each attempt succeeds with successProbability
+    LatencyDistribution withRetries(const LatencyDistribution& attempt, int fixedRetries, double retryIntervalSec, double successProbability) const;
+};
+
+#endif
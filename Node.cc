@@ -31,10 +31,13 @@ void Node::initialize()
     // Get the syste,
     system = check_and_cast<GarbageCollectionSystem *>(getParentModule());
 
-    // Extract module params
-    x = par("x");
-    y = par("y");
+    // The system has placed the node in the position store, from a loaded road layout or the x and y parameters
+    if (positionIndex < 0)
+        throw cRuntimeError("%s is not in the position store", getFullPath().c_str());
+    double x = getX(), y = getY();
     range = par("range");
+    getDisplayString().setTagArg("p", 0, (long)x);
+    getDisplayString().setTagArg("p", 1, (long)y);
 
     // New oval and render it
     std::string figureName = std::string("coverage_") + getName();
@@ -42,6 +45,129 @@ void Node::initialize()
 
     // Create coverage circle
     renderCoverageCircle(x, y);
+
+    transmitQueues.resize(gateSize("gate"));
+
+    telemetryInterval = par("telemetryInterval");
+    telemetryBurst = par("telemetryBurst");
+    telemetryBytes = par("telemetryBytes");
+    telemetryGate = par("telemetryGate");
+    if (telemetryInterval > SIMTIME_ZERO) {
+        if (telemetryGate < 0 || telemetryGate >= gateSize("gate"))
+            throw cRuntimeError("telemetryGate %d is not a gate of %s", telemetryGate, getFullName());
+        telemetryTimer = new cMessage("telemetryTimer");
+        scheduleAt(simTime() + telemetryInterval, telemetryTimer);
+    }
+}
+
+Node::~Node(){
+    for (TransmitQueue& queue : transmitQueues) {
+        for (auto& waiting : queue.classes)
+            for (QueuedMessage& queued : waiting)
+                delete queued.msg;
+        cancelAndDelete(queue.linkFree);
+    }
+    cancelAndDelete(telemetryTimer);
+}
+
+void Node::sendMessage(cMessage *msg, int gateIndex){
+    cChannel *link = gate("gate$o", gateIndex)->findTransmissionChannel();
+    TransmitQueue& queue = transmitQueues[gateIndex];
+
+    if (!link || (!link->isBusy() && !(queue.linkFree && queue.linkFree->isScheduled()))) {
+        transmit(msg, gateIndex, SIMTIME_ZERO);
+        return;
+    }
+
+    // FIFO keeps every class in one queue, so arrival order is kept across classes
+    int trafficClass = system->linkScheduling == GarbageCollectionSystem::SCHEDULE_FIFO ? 0 : system->getTrafficClass(msg);
+    queue.classes[trafficClass].push_back({msg, simTime()});
+
+    if (!queue.linkFree) {
+        queue.linkFree = new cMessage("linkFree");
+        queue.turnCredit = system->classWeights[queue.turnClass];
+    }
+    if (!queue.linkFree->isScheduled())
+        scheduleAt(link->getTransmissionFinishTime(), queue.linkFree);
+}
+
+// Queueing is the wait for the link only, holds before sendMessage() (service time, reply backoff) are not part of it
+void Node::transmit(cMessage *msg, int gateIndex, simtime_t queueingDelay){
+    system->recordQueueingDelay(msg, queueingDelay);
+    system->traceSend(this, msg);
+    send(msg, "gate$o", gateIndex);
+}
+
+// Strict priority takes the lowest class with a message, weighted round robin gives each class classWeights messages per turn
+bool Node::nextQueued(TransmitQueue& queue, QueuedMessage& next){
+    if (system->linkScheduling != GarbageCollectionSystem::SCHEDULE_WRR) {
+        for (auto& waiting : queue.classes) {
+            if (!waiting.empty()) {
+                next = waiting.front();
+                waiting.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    for (int tries = 0; tries <= NUM_TRAFFIC_CLASSES; tries++) {
+        std::deque<QueuedMessage>& waiting = queue.classes[queue.turnClass];
+        if (!waiting.empty() && queue.turnCredit > 0) {
+            queue.turnCredit--;
+            next = waiting.front();
+            waiting.pop_front();
+            return true;
+        }
+        queue.turnClass = (queue.turnClass + 1) % NUM_TRAFFIC_CLASSES;
+        queue.turnCredit = system->classWeights[queue.turnClass];
+    }
+    return false;
+}
+
+bool Node::handleLinkEvent(cMessage *msg){
+    system->traceReceive(this, msg);
+
+    if (msg == telemetryTimer) {
+        sendTelemetry();
+        scheduleAt(simTime() + telemetryInterval, telemetryTimer);
+        return true;
+    }
+
+    if (msg->isSelfMessage()) {
+        // A link finished its transmission, send the gate's next queued message
+        for (int gateIndex = 0; gateIndex < (int)transmitQueues.size(); gateIndex++) {
+            TransmitQueue& queue = transmitQueues[gateIndex];
+            if (msg != queue.linkFree) continue;
+
+            QueuedMessage next;
+            if (nextQueued(queue, next))
+                transmit(next.msg, gateIndex, simTime() - next.enqueued);
+            for (auto& waiting : queue.classes) {
+                if (!waiting.empty()) {
+                    scheduleAt(gate("gate$o", gateIndex)->findTransmissionChannel()->getTransmissionFinishTime(), queue.linkFree);
+                    break;
+                }
+            }
+            return true;
+        }
+        return false;
+    }
+
+    system->recordLatency(msg);
+    if (system->getMsgId(msg) == MSG_15_TELEMETRY) {
+        delete msg;
+        return true;
+    }
+    return false;
+}
+
+void Node::sendTelemetry(){
+    for (int i = 0; i < telemetryBurst; i++) {
+        cPacket *telemetry = system->createMessage(MSG_15_TELEMETRY);
+        telemetry->setByteLength(telemetryBytes);
+        sendMessage(telemetry, telemetryGate);
+    }
 }
 
 // Used for rendering the coverage circle given coords
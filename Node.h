@@ -10,6 +10,8 @@
 
 
 #include <string.h>
+#include <deque>
+#include <vector>
 #include <omnetpp.h>
 #include "inet/common/INETDefs.h"
 #include "inet/common/geometry/common/Coord.h"
@@ -27,9 +29,8 @@ class Node : public cSimpleModule
 {
 
 public:
-    // Public access of coords
-    double x;
-    double y;
+    // Slot of the node's coordinates in the system's position store, assigned before the nodes initialize
+    int positionIndex = -1;
 
 protected:
     // All subclasses can interact with the system
@@ -40,13 +41,50 @@ protected:
     // range of coverage
     double range = 0;
 
+    // Messages waiting for a busy link, one queue per traffic class, served in the system's linkScheduling order
+    struct QueuedMessage {
+        cMessage *msg;
+        simtime_t enqueued;                       // Start of the wait for the link, the creation time may be earlier
+    };
+    struct TransmitQueue {
+        std::deque<QueuedMessage> classes[NUM_TRAFFIC_CLASSES];
+        int turnClass = 0;                        // Weighted round robin position
+        int turnCredit = 0;                       // Messages the turn's class may still send
+        cMessage *linkFree = nullptr;             // Fires when the link finishes its transmission
+    };
+    std::vector<TransmitQueue> transmitQueues;    // Per gate$o index
+
+    // Background telemetry upload, disabled with telemetryInterval = 0
+    cMessage *telemetryTimer = nullptr;
+    simtime_t telemetryInterval;
+    int telemetryBurst = 0;
+    long telemetryBytes = 0;
+    int telemetryGate = 0;
+
 protected:
     virtual void initialize() override;
 
     // For rendering nodes initial coverage circles
     void renderCoverageCircle(double x, double y);
 
+    // send() on gate$o[gateIndex], traced when the trace export is on. Waits in the gate's transmit queue while its link is busy
+    void sendMessage(cMessage *msg, int gateIndex);
+
+    // Called first by every handleMessage(). Traces the arrival and records its class latency,
+    // returns true for the events Node handles itself (transmit queue and telemetry timers, received telemetry)
+    bool handleLinkEvent(cMessage *msg);
+
+    bool nextQueued(TransmitQueue& queue, QueuedMessage& next);
+    void transmit(cMessage *msg, int gateIndex, simtime_t queueingDelay);
+    void sendTelemetry();
+
 public:
+    virtual ~Node();
+
+    // Coordinates from the position store
+    double getX() const { return system->getPositions().getX(positionIndex); }
+    double getY() const { return system->getPositions().getY(positionIndex); }
+
     // Signals used for fast config when message exchange between can-cloud is complete
     static simsignal_t garbageCollectedSignalFromCan;
     static simsignal_t garbageCollectedSignalFromAnotherCan;
@@ -0,0 +1,44 @@
+#include "OutboundQueue.h"
+#include <algorithm>
+
+void OutboundQueue::push(simtime_t hostReleased)
+{
+    records.push_back(hostReleased);
+    recordsQueued++;
+    maxLength = std::max(maxLength, records.size());
+}
+
+int OutboundQueue::nextBatch()
+{
+    if (inFlight > 0 || records.empty())
+        return 0;
+    inFlight = std::min((int)records.size(), maxBatch);
+    batchId++;
+    batchesSent++;
+    return inFlight;
+}
+
+bool OutboundQueue::batchAcked(simtime_t now, long id)
+{
+    if (inFlight == 0 || id != batchId) {
+        staleAcks++;
+        return false;
+    }
+    for (; inFlight > 0; inFlight--) {
+        stallAvoided.collect(now - records.front());
+        records.pop_front();
+        burst++;
+    }
+    if (records.empty() && burst > 0) {
+        flushBurst.collect(burst);
+        burst = 0;
+    }
+    return true;
+}
+
+void OutboundQueue::batchLost()
+{
+    if (inFlight > 0)
+        batchesLost++;
+    inFlight = 0;
+}
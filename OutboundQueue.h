@@ -0,0 +1,52 @@
+#ifndef __SMARTGARBAGECOLLECTION_OUTBOUNDQUEUE_H_
+#define __SMARTGARBAGECOLLECTION_OUTBOUNDQUEUE_H_
+
+#include <deque>
+#include <omnetpp.h>
+using namespace omnetpp;
+
+/**
+ * Can-side store-and-forward queue of collect records. A record is added when the cloud does not answer a collect
+ * request in time and the can has released the host itself. The records go upstream in batches, one batch in flight
+ * at a time, and stay queued until the cloud acknowledges their batch, so a lost batch is sent again.
+ */
+class OutboundQueue
+{
+  protected:
+    int maxBatch;                       // 0 disables the queue
+    std::deque<simtime_t> records;      // Time the host was released, per record, oldest first
+    int inFlight = 0;                   // Records at the front of the queue that belong to the batch in flight
+    long batchId = 0;                   // Of the last batch sent, echoed by the cloud's acknowledgement
+    long burst = 0;                     // Records acknowledged since the queue last ran empty
+
+  public:
+    // Statistics
+    long recordsQueued = 0;
+    long batchesSent = 0;
+    long batchesLost = 0;
+    long staleAcks = 0;                 // Acknowledgements of batches no longer in flight, ignored
+    size_t maxLength = 0;
+    cHistogram stallAvoided{"hostStallAvoided"};   // Release of the host to the cloud's acknowledgement of its record
+    cHistogram flushBurst{"flushBurstSize"};       // Records flushed from a non-empty queue until it ran empty
+
+  public:
+    explicit OutboundQueue(int maxBatch = 0) : maxBatch(maxBatch) {}
+
+    bool enabled() const { return maxBatch > 0; }
+    bool empty() const { return records.empty(); }
+    bool batchInFlight() const { return inFlight > 0; }
+    size_t length() const { return records.size(); }
+    long getBatchId() const { return batchId; }
+
+    void push(simtime_t hostReleased);
+
+    // Records of the next batch, marked as in flight under a new batch id, 0 if a batch is in flight or nothing is queued
+    int nextBatch();
+
+    // The cloud acknowledged batch id, false unless it is the batch in flight. Or the batch in flight timed out and its
+    // records go out again in the next batch
+    bool batchAcked(simtime_t now, long id);
+    void batchLost();
+};
+
+#endif
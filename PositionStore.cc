@@ -0,0 +1,81 @@
+#include "PositionStore.h"
+
+#include <cmath>
+
+int PositionStore::add(double x, double y, double range, bool isCan){
+    int index = xs.size();
+    xs.push_back(x);
+    ys.push_back(y);
+    ranges.push_back(range);
+    canSlots.push_back(isCan ? (int)canXs.size() : -1);
+    if (isCan) {
+        canXs.push_back(x);
+        canYs.push_back(y);
+        canRanges.push_back(range);
+    }
+    return index;
+}
+
+void PositionStore::setPosition(int index, double x, double y){
+    xs[index] = x;
+    ys[index] = y;
+    int slot = canSlots[index];
+    if (slot >= 0) {
+        canXs[slot] = x;
+        canYs[slot] = y;
+    }
+}
+
+double PositionStore::distance(int a, int b) const {
+    double dx = xs[a] - xs[b];
+    double dy = ys[a] - ys[b];
+    return std::sqrt(dx*dx + dy*dy);
+}
+
+// Non-aliasing pointers and no branches in the loop bodies, so the loops can compile to packed SIMD. The square
+// root only vectorizes without errno handling (see makefrag). With the baseline x86-64 flags GCC vectorizes the
+// first loop with SSE2, the byte mask of the second loop only with AVX2=1 (see makefrag)
+static void scanKernel(size_t n, double x, double y, double range, double propSpeed,
+                       const double *__restrict cx, const double *__restrict cy, const double *__restrict cr,
+                       double *__restrict distance, uint8_t *__restrict inRange, double *__restrict delay)
+{
+    for (size_t i = 0; i < n; i++) {
+        double dx = x - cx[i];
+        double dy = y - cy[i];
+        double d = std::sqrt(dx*dx + dy*dy);
+        distance[i] = d;
+        delay[i] = d / propSpeed;
+    }
+    for (size_t i = 0; i < n; i++)
+        inRange[i] = distance[i] <= range + cr[i];
+}
+
+void PositionStore::scanCans(double x, double y, double range, double propSpeed, CanScan& out) const {
+    size_t n = canXs.size();
+    out.distance.resize(n);
+    out.inRange.resize(n);
+    out.propagationDelay.resize(n);
+    scanKernel(n, x, y, range, propSpeed, canXs.data(), canYs.data(), canRanges.data(),
+               out.distance.data(), out.inRange.data(), out.propagationDelay.data());
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+__attribute__((optimize("no-tree-vectorize")))
+#endif
+void PositionStore::scanCansScalar(double x, double y, double range, double propSpeed, CanScan& out) const {
+    size_t n = canXs.size();
+    out.distance.resize(n);
+    out.inRange.resize(n);
+    out.propagationDelay.resize(n);
+#if defined(__clang__)
+#pragma clang loop vectorize(disable) interleave(disable)
+#endif
+    for (size_t i = 0; i < n; i++) {
+        double dx = x - canXs[i];
+        double dy = y - canYs[i];
+        double d = std::sqrt(dx*dx + dy*dy);
+        out.distance[i] = d;
+        out.inRange[i] = d <= range + canRanges[i];
+        out.propagationDelay[i] = d / propSpeed;
+    }
+}
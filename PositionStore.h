@@ -0,0 +1,50 @@
+#ifndef __SMARTGARBAGECOLLECTION_POSITIONSTORE_H_
+#define __SMARTGARBAGECOLLECTION_POSITIONSTORE_H_
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Coordinates and coverage ranges of all nodes as struct-of-arrays, indexed by the node's positionIndex.
+ * The cans are additionally kept in their own contiguous arrays, so scanCans() can compute the distance,
+ * the coverage overlap and the propagation delay of one host to every can in a single branch free loop
+ * that the compiler vectorizes.
+ */
+class PositionStore
+{
+  public:
+    // Output of scanCans(), index is the can slot
+    struct CanScan {
+        std::vector<double> distance;
+        std::vector<uint8_t> inRange;          // Coverage circles overlap
+        std::vector<double> propagationDelay;  // Seconds
+    };
+
+  protected:
+    std::vector<double> xs, ys, ranges;
+    std::vector<int> canSlots;                 // Can slot of each index, -1 for other nodes
+
+    // Cans only, slot order
+    std::vector<double> canXs, canYs, canRanges;
+
+  public:
+    // Returns the new node's index
+    int add(double x, double y, double range, bool isCan);
+
+    void setPosition(int index, double x, double y);
+    double getX(int index) const { return xs[index]; }
+    double getY(int index) const { return ys[index]; }
+    double getRange(int index) const { return ranges[index]; }
+    double distance(int a, int b) const;
+
+    int getNumCans() const { return canXs.size(); }
+    int canSlotOf(int index) const { return canSlots[index]; }
+
+    // Distances, overlaps and propagation delays from a point with the given coverage range to all cans
+    void scanCans(double x, double y, double range, double propSpeed, CanScan& out) const;
+
+    // Same results one can at a time, kept out of the vectorizer, the baseline of the position benchmark
+    void scanCansScalar(double x, double y, double range, double propSpeed, CanScan& out) const;
+};
+
+#endif
@@ -11,32 +11,162 @@ void RealisticDelayChannel::initialize()
     baseLatency = par("baseLatency");
     jitterPercentage = par("jitterPercentage");
     propSpeed = par("propSpeed");
+
+    applyDelayModel = par("applyDelayModel");
+    delayModelRng = par("delayModelRng");
+
+    lossModelEnabled = par("lossModelEnabled");
+    lossRng = par("lossRng");
+    if (lossModelEnabled)
+        buildLossTable();
+    parseOutageSchedule();
+}
+
+// "30s-60s" is an outage, "30s-60s*4" a window with four times the base latency
+void RealisticDelayChannel::parseOutageSchedule()
+{
+    cStringTokenizer tokenizer(par("outageSchedule"));
+    while (tokenizer.hasMoreTokens()) {
+        std::string window = tokenizer.nextToken();
+        size_t dash = window.find('-', 1);
+        size_t star = window.find('*');
+        if (dash == std::string::npos)
+            throw cRuntimeError("Bad outageSchedule entry '%s', expected <start>-<end> or <start>-<end>*<factor>", window.c_str());
+
+        OutageWindow outage;
+        outage.start = SimTime::parse(window.substr(0, dash).c_str());
+        outage.end = SimTime::parse(window.substr(dash + 1, star == std::string::npos ? std::string::npos : star - dash - 1).c_str());
+        outage.latencyFactor = star == std::string::npos ? 0 : atof(window.c_str() + star + 1);
+        if (outage.end <= outage.start || outage.latencyFactor < 0)
+            throw cRuntimeError("Bad outageSchedule entry '%s', the window is empty or the factor negative", window.c_str());
+        outages.push_back(outage);
+    }
+}
+
+double RealisticDelayChannel::latencyFactor(simtime_t t) const
+{
+    for (const OutageWindow& outage : outages)
+        if (t >= outage.start && t < outage.end)
+            return outage.latencyFactor;
+    return 1;
+}
+
+// Sample the PER curve once at startup, floor + (ceiling - floor) / (1 + e^(-(d - mid) / slope))
+void RealisticDelayChannel::buildLossTable()
+{
+    double floorPer = par("lossFloor");
+    double ceilingPer = par("lossCeiling");
+    double midDistance = par("lossMidDistance");
+    double slope = par("lossSlope");
+    double maxDistance = par("lossTableMaxDistance");
+    lossTableResolution = par("lossTableResolution");
+
+    if (lossTableResolution <= 0 || slope <= 0)
+        throw cRuntimeError("lossTableResolution and lossSlope must be positive");
+
+    size_t numEntries = (size_t)(maxDistance / lossTableResolution) + 1;
+    perTable.resize(numEntries);
+    for (size_t i = 0; i < numEntries; i++) {
+        double distanceM = i * lossTableResolution;
+        perTable[i] = floorPer + (ceilingPer - floorPer) / (1 + exp(-(distanceM - midDistance) / slope));
+    }
+}
+
+// Nearest table entry, distances past the end of the table use the last entry
+double RealisticDelayChannel::packetErrorRate(double distanceM) const
+{
+    if (perTable.empty()) return 0;
+
+    size_t index = (size_t)(distanceM / lossTableResolution + 0.5);
+    if (index >= perTable.size()) index = perTable.size() - 1;
+    return perTable[index];
+}
+
+// Runs for every message on the link, optionally delays it by the delay model and discards it with the PER for the current sender-receiver distance
+void RealisticDelayChannel::processMessage(cMessage *msg, const SendOptions& options, simtime_t t, Result& result)
+{
+    cDatarateChannel::processMessage(msg, options, t, result);
+
+    if (!result.discard && !outages.empty() && isDown(t)) {
+        EV << "Link outage dropped " << msg->getName() << "\n";
+        result.discard = true;
+        numOutageDrops++;
+        return;
+    }
+
+    if (result.discard || (!applyDelayModel && !lossModelEnabled)) return;
+
+    // Both ends must be system nodes to have a distance
+    Node *srcNode = dynamic_cast<Node *>(getSourceGate()->getOwnerModule());
+    Node *dstNode = dynamic_cast<Node *>(getSourceGate()->getNextGate()->getOwnerModule());
+    if (!srcNode || !dstNode) return;
+
+    // Own draw, the senders' draws stay the ones reported in GlobalDelays
+    if (applyDelayModel)
+        result.delay += computeDynamicDelay(srcNode, dstNode, delayModelRng);
+
+    if (!lossModelEnabled) return;
+
+    double per = packetErrorRate(distanceBetween(srcNode, dstNode));
+    if (uniform(0, 1, lossRng) < per) {
+        EV << "Loss model dropped " << msg->getName() << " (PER " << per << ")\n";
+        result.discard = true;
+        numLostMessages++;
+    }
+}
+
+void RealisticDelayChannel::finish()
+{
+    if (lossModelEnabled)
+        recordScalar("lostByLossModel", numLostMessages);
+    if (!outages.empty())
+        recordScalar("lostByOutage", numOutageDrops);
+}
+
+HopModel RealisticDelayChannel::hopModel(double distanceM, double baseScale) const
+{
+    HopModel model;
+    model.baseSec = SIMTIME_DBL(baseLatency) * baseScale;
+    model.jitterPercentage = jitterPercentage;
+    model.propagationSec = distanceM / propSpeed;
+    model.lossProbability = packetErrorRate(distanceM);
+    return model;
+}
+
+double RealisticDelayChannel::distanceBetween(Node *src, Node *dst)
+{
+    double dx = src->getX() - dst->getX();
+    double dy = src->getY() - dst->getY();
+    return sqrt(dx*dx + dy*dy);
 }
 
 // calculate delay from src to dst
-simtime_t RealisticDelayChannel::computeDynamicDelay(cModule *src, cModule *dst)
+simtime_t RealisticDelayChannel::computeDynamicDelay(cModule *src, cModule *dst, int rng)
 {
     // Cast modules to Node pointers
     Node *srcNode = check_and_cast<Node *>(src);
     Node *dstNode = check_and_cast<Node *>(dst);
 
-    // Calculate the differences in coords
-    double dx = srcNode->x - dstNode->x;
-    double dy = srcNode->y - dstNode->y;
     // Calculate the distance in meters, pythagoras
-    double distanceM = sqrt(dx*dx + dy*dy);
+    double distanceM = distanceBetween(srcNode, dstNode);
 
     // baseLatency in seconds
     double baseSec = SIMTIME_DBL(baseLatency);
+    double factor = outages.empty() ? 1 : latencyFactor(simTime());
+    if (factor > 0)
+        baseSec *= factor; // Messages of an outage are dropped, their modeled delay stays the usual one
 
     // Calculate jitter in seconds
-    double jitterSec = uniform(-jitterPercentage, jitterPercentage) * baseSec;
+    double jitterSec = uniform(-jitterPercentage, jitterPercentage, rng) * baseSec;
     double propagationSec = distanceM / propSpeed;   // meters / (m/s) = seconds
 
     // calculate the total delay, if its less than zero, set delay to zero
     double totalMs = (baseSec + jitterSec + propagationSec) * 1000;
     if (totalMs < 0) totalMs = 0;
 
+    if (sampleDelays && rng == 0)
+        delaySamples.push_back(totalMs / 1000);
+
     // Return in simtime ms
     return SimTime(totalMs, SIMTIME_MS);
 }
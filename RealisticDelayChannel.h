@@ -1,9 +1,13 @@
 #ifndef __SMARTGARBAGECOLLECTION_REALISTICDELAYCHANNEL_H_
 #define __SMARTGARBAGECOLLECTION_REALISTICDELAYCHANNEL_H_
 
+#include <vector>
 #include <omnetpp.h>
+#include "LatencyEstimator.h"
 using namespace omnetpp;
 
+class Node;
+
 /**
  * Custom channel that adds a configurable base latency
  * on top of the regular datarate-based delay.
@@ -16,12 +20,64 @@ class RealisticDelayChannel : public cDatarateChannel
     double jitterPercentage;
     double propSpeed;
 
+    // Normally the modeled latency only feeds the statistics and messages arrive after the datarate delay,
+    // with applyDelayModel the channel also delays each message by a draw of the model
+    bool applyDelayModel = false;
+    int delayModelRng = 0;
+
+    // Distance based loss model, packet error rate (PER) is precomputed per distance step so a send is a table lookup
+    bool lossModelEnabled = false;
+    int lossRng = 0; // Local RNG of the loss draws, kept apart from the jitter draws for common random numbers
+    double lossTableResolution = 1;
+    std::vector<double> perTable;
+    long numLostMessages = 0;
+
+    // Scheduled outages and degradations, a zero factor drops every message of the window
+    struct OutageWindow {
+        simtime_t start, end;
+        double latencyFactor;
+    };
+    std::vector<OutageWindow> outages;
+    long numOutageDrops = 0;
+
+    // Delays of this run, kept for the per-link statistics of the sequential stopping rule
+    bool sampleDelays = false;
+    std::vector<double> delaySamples;
+
   protected:
     virtual void initialize() override;
+    virtual void finish() override;
+    virtual void processMessage(cMessage *msg, const SendOptions& options, simtime_t t, Result& result) override;
+
+    // Fills perTable from the logistic PER curve given by the loss parameters
+    void buildLossTable();
+
+    // Fills outages from the outageSchedule parameter
+    void parseOutageSchedule();
 
   public:
     // Used for calculating the dynamic delay for a link from src to dst, returns the delay as simtime_t
-    simtime_t computeDynamicDelay(cModule *src, cModule *dst);
+    // The jitter is drawn from the given local RNG of the channel
+    simtime_t computeDynamicDelay(cModule *src, cModule *dst, int rng = 0);
+
+    // Looks up the packet error rate for a given distance in meters
+    double packetErrorRate(double distanceM) const;
+
+    // Link state from the outage schedule, the factor is 1 outside its windows
+    bool isDown(simtime_t t) const { return latencyFactor(t) == 0; }
+    double latencyFactor(simtime_t t) const;
+
+    // The delay model of computeDynamicDelay() as a hop for the analytic estimator, baseScale scales the base latency
+    HopModel hopModel(double distanceM, double baseScale = 1) const;
+
+    // Keep every delay computed on RNG 0, draws on other RNGs are side computations and not part of the run
+    void setSampleDelays(bool enabled) { sampleDelays = enabled; }
+    const std::vector<double>& getDelaySamples() const { return delaySamples; }
+
+    double getPropSpeed() const { return propSpeed; }
+
+    // Euclidean distance between two nodes in meters
+    static double distanceBetween(Node *src, Node *dst);
 };
 
 #endif
@@ -0,0 +1,312 @@
+#include "RoadNetwork.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <queue>
+#include <sstream>
+#include <unordered_map>
+#include <omnetpp.h>
+
+using namespace omnetpp;
+
+void RoadNetwork::load(const std::string& fileName, double requestedCellSize)
+{
+    std::ifstream in(fileName);
+    if (!in)
+        throw cRuntimeError("Cannot open road network file '%s'", fileName.c_str());
+
+    // File ids are arbitrary, nodes are renumbered densely in file order
+    std::unordered_map<long, int> nodeIndex;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(in, line)) {
+        lineNumber++;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos)
+            line.erase(comment);
+
+        std::istringstream fields(line);
+        std::string kind;
+        if (!(fields >> kind))
+            continue;
+
+        if (kind == "node") {
+            long id;
+            double x, y;
+            if (!(fields >> id >> x >> y))
+                throw cRuntimeError("%s:%d: expected 'node <id> <x> <y>'", fileName.c_str(), lineNumber);
+            if (!nodeIndex.emplace(id, (int)nodeX.size()).second)
+                throw cRuntimeError("%s:%d: duplicate node %ld", fileName.c_str(), lineNumber, id);
+            nodeX.push_back(x);
+            nodeY.push_back(y);
+        }
+        else if (kind == "edge") {
+            long from, to;
+            double speed;
+            std::string oneway;
+            if (!(fields >> from >> to >> speed))
+                throw cRuntimeError("%s:%d: expected 'edge <fromId> <toId> <speed> [oneway]'", fileName.c_str(), lineNumber);
+            fields >> oneway;
+
+            auto a = nodeIndex.find(from), b = nodeIndex.find(to);
+            if (a == nodeIndex.end() || b == nodeIndex.end())
+                throw cRuntimeError("%s:%d: edge refers to an unknown node, nodes must come before their edges", fileName.c_str(), lineNumber);
+            if (speed <= 0)
+                throw cRuntimeError("%s:%d: edge speed must be positive", fileName.c_str(), lineNumber);
+
+            segmentFrom.push_back(a->second);
+            segmentTo.push_back(b->second);
+            segmentLength.push_back(std::hypot(nodeX[b->second] - nodeX[a->second], nodeY[b->second] - nodeY[a->second]));
+            segmentSpeed.push_back(speed);
+            segmentOneway.push_back(oneway == "oneway");
+        }
+        else
+            throw cRuntimeError("%s:%d: unknown entry '%s'", fileName.c_str(), lineNumber, kind.c_str());
+    }
+
+    if (segmentFrom.empty())
+        throw cRuntimeError("Road network file '%s' has no edges", fileName.c_str());
+
+    buildAdjacency();
+    buildGrid(requestedCellSize);
+}
+
+// Counting sort of the directed edges by their source node
+void RoadNetwork::buildAdjacency()
+{
+    int numNodes = nodeX.size();
+    edgeStart.assign(numNodes + 1, 0);
+    for (int s = 0; s < getNumSegments(); s++) {
+        edgeStart[segmentFrom[s] + 1]++;
+        if (!segmentOneway[s])
+            edgeStart[segmentTo[s] + 1]++;
+    }
+    for (int i = 0; i < numNodes; i++)
+        edgeStart[i + 1] += edgeStart[i];
+
+    edgeTarget.resize(edgeStart[numNodes]);
+    edgeSegment.resize(edgeStart[numNodes]);
+    std::vector<int> fill(edgeStart.begin(), edgeStart.end() - 1);
+    for (int s = 0; s < getNumSegments(); s++) {
+        int e = fill[segmentFrom[s]]++;
+        edgeTarget[e] = segmentTo[s];
+        edgeSegment[e] = s;
+        if (!segmentOneway[s]) {
+            e = fill[segmentTo[s]]++;
+            edgeTarget[e] = segmentFrom[s];
+            edgeSegment[e] = s;
+        }
+    }
+}
+
+void RoadNetwork::buildGrid(double requestedCellSize)
+{
+    minX = *std::min_element(nodeX.begin(), nodeX.end());
+    maxX = *std::max_element(nodeX.begin(), nodeX.end());
+    minY = *std::min_element(nodeY.begin(), nodeY.end());
+    maxY = *std::max_element(nodeY.begin(), nodeY.end());
+
+    // Keep the grid within a few cells per segment, a small cell size on a large district would mostly hold empty cells
+    cellSize = requestedCellSize > 0 ? requestedCellSize : 100;
+    double maxCells = std::max(1024.0, 4.0 * getNumSegments());
+    while (((maxX - minX) / cellSize + 1) * ((maxY - minY) / cellSize + 1) > maxCells)
+        cellSize *= 2;
+    cellsX = (int)((maxX - minX) / cellSize) + 1;
+    cellsY = (int)((maxY - minY) / cellSize) + 1;
+
+    // Two passes over the segments' bounding boxes, count then fill
+    cellStart.assign(cellsX * cellsY + 1, 0);
+    for (int pass = 0; pass < 2; pass++) {
+        std::vector<int> fill;
+        if (pass == 1) {
+            for (int c = 0; c < cellsX * cellsY; c++)
+                cellStart[c + 1] += cellStart[c];
+            cellSegments.resize(cellStart.back());
+            fill.assign(cellStart.begin(), cellStart.end() - 1);
+        }
+        for (int s = 0; s < getNumSegments(); s++) {
+            double x1, y1, x2, y2;
+            getSegment(s, x1, y1, x2, y2);
+            for (int cy = cellY(std::min(y1, y2)); cy <= cellY(std::max(y1, y2)); cy++)
+                for (int cx = cellX(std::min(x1, x2)); cx <= cellX(std::max(x1, x2)); cx++) {
+                    int c = cy * cellsX + cx;
+                    if (pass == 0) cellStart[c + 1]++;
+                    else cellSegments[fill[c]++] = s;
+                }
+        }
+    }
+}
+
+int RoadNetwork::cellX(double x) const
+{
+    return std::min(std::max((int)((x - minX) / cellSize), 0), cellsX - 1);
+}
+
+int RoadNetwork::cellY(double y) const
+{
+    return std::min(std::max((int)((y - minY) / cellSize), 0), cellsY - 1);
+}
+
+void RoadNetwork::getSegment(int segment, double& x1, double& y1, double& x2, double& y2) const
+{
+    x1 = nodeX[segmentFrom[segment]];
+    y1 = nodeY[segmentFrom[segment]];
+    x2 = nodeX[segmentTo[segment]];
+    y2 = nodeY[segmentTo[segment]];
+}
+
+RoadNetwork::SnapPoint RoadNetwork::project(int segment, double x, double y) const
+{
+    double x1, y1, x2, y2;
+    getSegment(segment, x1, y1, x2, y2);
+    double dx = x2 - x1, dy = y2 - y1;
+    double lengthSquared = dx * dx + dy * dy;
+
+    SnapPoint p;
+    p.segment = segment;
+    p.t = lengthSquared > 0 ? std::min(std::max(((x - x1) * dx + (y - y1) * dy) / lengthSquared, 0.0), 1.0) : 0;
+    p.x = x1 + p.t * dx;
+    p.y = y1 + p.t * dy;
+    p.distance = std::hypot(x - p.x, y - p.y);
+    return p;
+}
+
+// Rings of cells around the position, a segment at distance d is found by ring floor(d / cellSize) + 1 at the latest
+RoadNetwork::SnapPoint RoadNetwork::snap(double x, double y) const
+{
+    SnapPoint best;
+    best.distance = std::numeric_limits<double>::infinity();
+    int cx = cellX(x), cy = cellY(y);
+    int maxRing = std::max(cellsX, cellsY);
+
+    for (int ring = 0; ring <= maxRing; ring++) {
+        for (int j = cy - ring; j <= cy + ring; j++) {
+            if (j < 0 || j >= cellsY) continue;
+            bool edgeRow = j == cy - ring || j == cy + ring;
+            for (int i = cx - ring; i <= cx + ring; i += edgeRow ? 1 : 2 * ring) {
+                if (i >= 0 && i < cellsX) {
+                    int c = j * cellsX + i;
+                    for (int k = cellStart[c]; k < cellStart[c + 1]; k++) {
+                        SnapPoint p = project(cellSegments[k], x, y);
+                        if (p.distance < best.distance)
+                            best = p;
+                    }
+                }
+                if (ring == 0) break;
+            }
+        }
+        if (best.distance <= ring * cellSize)
+            break;
+    }
+    return best;
+}
+
+// Seconds to drive the given fraction of a segment
+double RoadNetwork::travelTime(int segment, double fraction) const
+{
+    return fraction * segmentLength[segment] / segmentSpeed[segment];
+}
+
+// Dijkstra over the nodes, seeded with the ends of the start segment that can be driven to from the start position
+std::vector<RoadNetwork::RoutePoint> RoadNetwork::route(const SnapPoint& from, const SnapPoint& to) const
+{
+    const double inf = std::numeric_limits<double>::infinity();
+    int numNodes = getNumNodes();
+    std::vector<double> time(numNodes, inf);
+    std::vector<int> viaEdge(numNodes, -1), viaNode(numNodes, -1);
+
+    typedef std::pair<double, int> Entry;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+
+    int s = from.segment;
+    time[segmentTo[s]] = travelTime(s, 1 - from.t);
+    queue.push({time[segmentTo[s]], segmentTo[s]});
+    if (!segmentOneway[s] && travelTime(s, from.t) < time[segmentFrom[s]]) {
+        time[segmentFrom[s]] = travelTime(s, from.t);
+        queue.push({time[segmentFrom[s]], segmentFrom[s]});
+    }
+
+    while (!queue.empty()) {
+        Entry top = queue.top();
+        queue.pop();
+        int u = top.second;
+        if (top.first > time[u]) continue;
+
+        for (int e = edgeStart[u]; e < edgeStart[u + 1]; e++) {
+            int v = edgeTarget[e];
+            double t = time[u] + travelTime(edgeSegment[e], 1);
+            if (t < time[v]) {
+                time[v] = t;
+                viaEdge[v] = e;
+                viaNode[v] = u;
+                queue.push({t, v});
+            }
+        }
+    }
+
+    // Enter the target segment from whichever end is allowed and faster, or stay on the start segment
+    int g = to.segment;
+    int lastNode = -1;
+    double best = inf;
+    if (time[segmentFrom[g]] + travelTime(g, to.t) < best) {
+        best = time[segmentFrom[g]] + travelTime(g, to.t);
+        lastNode = segmentFrom[g];
+    }
+    if (!segmentOneway[g] && time[segmentTo[g]] + travelTime(g, 1 - to.t) < best) {
+        best = time[segmentTo[g]] + travelTime(g, 1 - to.t);
+        lastNode = segmentTo[g];
+    }
+    if (s == g && (to.t >= from.t || !segmentOneway[s]) && travelTime(s, std::fabs(to.t - from.t)) <= best) {
+        best = travelTime(s, std::fabs(to.t - from.t));
+        lastNode = -1;
+    }
+    if (best == inf)
+        throw cRuntimeError("No road route from (%g, %g) to (%g, %g)", from.x, from.y, to.x, to.y);
+
+    std::vector<RoutePoint> points;
+    points.push_back({to.x, to.y, segmentSpeed[g]});
+    for (int n = lastNode; n != -1; n = viaNode[n]) {
+        // The speed of each corner is the one of the road leading to it, the first node is reached on the start segment
+        double speed = viaEdge[n] != -1 ? segmentSpeed[edgeSegment[viaEdge[n]]] : segmentSpeed[s];
+        points.push_back({nodeX[n], nodeY[n], speed});
+    }
+    points.push_back({from.x, from.y, 0});
+    std::reverse(points.begin(), points.end());
+    return points;
+}
+
+std::vector<RoadNetwork::CanSite> RoadNetwork::loadCanSites(const std::string& fileName) const
+{
+    std::ifstream in(fileName);
+    if (!in)
+        throw cRuntimeError("Cannot open can layout file '%s'", fileName.c_str());
+
+    std::vector<CanSite> sites;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(in, line)) {
+        lineNumber++;
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream fields(line);
+        std::string id, x, y;
+        if (!std::getline(fields, id, ',') || !std::getline(fields, x, ',') || !std::getline(fields, y, ','))
+            throw cRuntimeError("%s:%d: expected 'id,x,y'", fileName.c_str(), lineNumber);
+
+        CanSite site;
+        site.id = id;
+        try {
+            site.x = std::stod(x);
+            site.y = std::stod(y);
+        }
+        catch (const std::exception&) {
+            if (lineNumber == 1) continue; // Header row
+            throw cRuntimeError("%s:%d: bad coordinates '%s,%s'", fileName.c_str(), lineNumber, x.c_str(), y.c_str());
+        }
+        site.road = snap(site.x, site.y);
+        sites.push_back(site);
+    }
+    return sites;
+}
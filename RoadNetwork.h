@@ -0,0 +1,87 @@
+#ifndef __SMARTGARBAGECOLLECTION_ROADNETWORK_H_
+#define __SMARTGARBAGECOLLECTION_ROADNETWORK_H_
+
+#include <string>
+#include <vector>
+
+/**
+ * Road graph loaded from a local file. Nodes and directed edges are kept in compact (CSR) arrays,
+ * road segments are bucketed in a uniform grid so snapping a position to the nearest road only
+ * looks at the cells around it.
+ *
+ * File format, one entry per line, '#' starts a comment:
+ *   node <id> <x> <y>
+ *   edge <fromId> <toId> <speed> [oneway]
+ * Coordinates are canvas units (m), speeds are in canvas units per second like the turtle legs.
+ */
+class RoadNetwork
+{
+  public:
+    // Position on a road segment
+    struct SnapPoint {
+        int segment = -1;
+        double t = 0;        // Fraction along the segment from its first node
+        double x = 0, y = 0;
+        double distance = 0; // From the position that was snapped
+    };
+
+    // Corner of a route, speed is the one to drive from the previous corner
+    struct RoutePoint {
+        double x, y, speed;
+    };
+
+    // A row of the can layout CSV with its snapped road position
+    struct CanSite {
+        std::string id;
+        double x, y;
+        SnapPoint road;
+    };
+
+  protected:
+    std::vector<double> nodeX, nodeY;
+
+    // Road segments, one per edge line of the file
+    std::vector<int> segmentFrom, segmentTo;
+    std::vector<double> segmentLength, segmentSpeed;
+    std::vector<char> segmentOneway;
+
+    // Directed edges leaving node i are edgeStart[i]..edgeStart[i + 1] - 1
+    std::vector<int> edgeStart, edgeTarget, edgeSegment;
+
+    // Uniform grid over the bounding box, segments crossing cell c are cellStart[c]..cellStart[c + 1] - 1
+    double minX = 0, minY = 0, maxX = 0, maxY = 0;
+    double cellSize = 0;
+    int cellsX = 0, cellsY = 0;
+    std::vector<int> cellStart, cellSegments;
+
+  public:
+    // Reads the graph and builds the adjacency arrays and the grid, cellSize is grown if the grid would be much larger than the graph
+    void load(const std::string& fileName, double cellSize);
+
+    // Reads "id,x,y" rows, a header row is skipped, and snaps every can to its nearest road
+    std::vector<CanSite> loadCanSites(const std::string& fileName) const;
+
+    int getNumNodes() const { return nodeX.size(); }
+    int getNumSegments() const { return segmentFrom.size(); }
+    int getNumEdges() const { return edgeTarget.size(); }
+    double getCellSize() const { return cellSize; }
+    double getMaxX() const { return maxX; }
+    double getMaxY() const { return maxY; }
+    void getSegment(int segment, double& x1, double& y1, double& x2, double& y2) const;
+
+    // Nearest point on any road
+    SnapPoint snap(double x, double y) const;
+
+    // Fastest path between two road positions, honouring one-way roads, starting with from and ending with to
+    std::vector<RoutePoint> route(const SnapPoint& from, const SnapPoint& to) const;
+
+  protected:
+    SnapPoint project(int segment, double x, double y) const;
+    double travelTime(int segment, double fraction) const;
+    void buildAdjacency();
+    void buildGrid(double requestedCellSize);
+    int cellX(double x) const;
+    int cellY(double y) const;
+};
+
+#endif
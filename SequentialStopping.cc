@@ -0,0 +1,137 @@
+#include "SequentialStopping.h"
+#include "StudentT.h"
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <omnetpp.h>
+
+using namespace omnetpp;
+
+SequentialStopping::SequentialStopping(const std::string& stateFile, double relativePrecision, double cpuBudgetSec, long minReplications)
+    : stateFile(stateFile), relativePrecision(relativePrecision), cpuBudgetSec(cpuBudgetSec), minReplications(minReplications)
+{
+}
+
+void SequentialStopping::reset()
+{
+    std::ofstream out(stateFile, std::ios::trunc);
+    if (!out)
+        throw cRuntimeError("Cannot write sequential stopping state file '%s'", stateFile.c_str());
+    out << "replication,cpuSeconds,link,mean,p99\n";
+
+    means.clear();
+    p99s.clear();
+    cpuSecondsPerReplication.clear();
+}
+
+// A missing file means no replications yet
+void SequentialStopping::load()
+{
+    means.clear();
+    p99s.clear();
+    cpuSecondsPerReplication.clear();
+
+    std::ifstream in(stateFile);
+    std::string line;
+    std::getline(in, line); // Header
+    while (std::getline(in, line)) {
+        std::istringstream row(line);
+        std::string field, link;
+        long replication;
+        double cpuSeconds, mean, p99;
+
+        std::getline(row, field, ','); replication = std::stol(field);
+        std::getline(row, field, ','); cpuSeconds = std::stod(field);
+        std::getline(row, link, ',');
+        std::getline(row, field, ','); mean = std::stod(field);
+        std::getline(row, field, ','); p99 = std::stod(field);
+
+        cpuSecondsPerReplication[replication] = cpuSeconds;
+        if (link.empty()) continue; // Replication without any link samples
+        means[link].push_back(mean);
+        p99s[link].push_back(p99);
+    }
+}
+
+void SequentialStopping::append(long replication, double cpuSeconds, const std::vector<LinkResult>& results)
+{
+    std::ofstream out(stateFile, std::ios::app);
+    if (!out)
+        throw cRuntimeError("Cannot write sequential stopping state file '%s'", stateFile.c_str());
+
+    out.precision(12);
+    if (results.empty())
+        out << replication << "," << cpuSeconds << ",,0,0\n";
+    for (const LinkResult& result : results) {
+        out << replication << "," << cpuSeconds << "," << result.link << "," << result.mean << "," << result.p99 << "\n";
+        means[result.link].push_back(result.mean);
+        p99s[result.link].push_back(result.p99);
+    }
+    cpuSecondsPerReplication[replication] = cpuSeconds;
+}
+
+double SequentialStopping::getCpuSecondsUsed() const
+{
+    double total = 0;
+    for (auto& entry : cpuSecondsPerReplication)
+        total += entry.second;
+    return total;
+}
+
+// Mean across replications with a t based 95% confidence interval
+SequentialStopping::Estimate SequentialStopping::estimate(const std::vector<double>& samples)
+{
+    Estimate result;
+    result.n = samples.size();
+    if (result.n == 0) return result;
+
+    double sum = 0;
+    for (double sample : samples) sum += sample;
+    result.mean = sum / result.n;
+
+    if (result.n < 2) {
+        result.relativeHalfWidth = INFINITY;
+        return result;
+    }
+
+    double squares = 0;
+    for (double sample : samples) squares += (sample - result.mean) * (sample - result.mean);
+    double stddev = std::sqrt(squares / (result.n - 1));
+    double halfWidth = studentT975(result.n - 1) * stddev / std::sqrt((double)result.n);
+    result.relativeHalfWidth = result.mean != 0 ? halfWidth / std::fabs(result.mean) : (halfWidth == 0 ? 0 : INFINITY);
+    return result;
+}
+
+std::map<std::string, SequentialStopping::Estimate> SequentialStopping::meanEstimates() const
+{
+    std::map<std::string, Estimate> result;
+    for (auto& entry : means)
+        result[entry.first] = estimate(entry.second);
+    return result;
+}
+
+std::map<std::string, SequentialStopping::Estimate> SequentialStopping::p99Estimates() const
+{
+    std::map<std::string, Estimate> result;
+    for (auto& entry : p99s)
+        result[entry.first] = estimate(entry.second);
+    return result;
+}
+
+bool SequentialStopping::targetReached() const
+{
+    if (getNumReplications() < minReplications || means.empty())
+        return false;
+
+    for (auto& entry : meanEstimates())
+        if (entry.second.relativeHalfWidth > relativePrecision) return false;
+    for (auto& entry : p99Estimates())
+        if (entry.second.relativeHalfWidth > relativePrecision) return false;
+    return true;
+}
+
+bool SequentialStopping::budgetExhausted() const
+{
+    return getCpuSecondsUsed() >= cpuBudgetSec;
+}
@@ -0,0 +1,66 @@
+#ifndef __SMARTGARBAGECOLLECTION_SEQUENTIALSTOPPING_H_
+#define __SMARTGARBAGECOLLECTION_SEQUENTIALSTOPPING_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Sequential stopping rule across replications. Every replication appends its per-link mean and P99 latency
+ * to a CSV state file, the controller reads all rows back and decides whether the confidence targets are met.
+ * Replications of a config must run one after another (e.g. one Cmdenv process with -r 0..N), not in parallel.
+ */
+class SequentialStopping
+{
+  public:
+    // Result of one replication for one link
+    struct LinkResult {
+        std::string link;
+        double mean = 0;
+        double p99 = 0;
+    };
+
+    // Running estimate of one quantity across replications
+    struct Estimate {
+        long n = 0;
+        double mean = 0;
+        double relativeHalfWidth = 0; // 95% CI half-width divided by the mean
+    };
+
+  protected:
+    std::string stateFile;
+    double relativePrecision;
+    double cpuBudgetSec;
+    long minReplications;
+
+    // Loaded state
+    std::map<std::string, std::vector<double>> means, p99s;
+    std::map<long, double> cpuSecondsPerReplication;
+
+  protected:
+    static Estimate estimate(const std::vector<double>& samples);
+
+  public:
+    SequentialStopping(const std::string& stateFile, double relativePrecision, double cpuBudgetSec, long minReplications);
+
+    // Drops all earlier replications
+    void reset();
+
+    // Reads all replications recorded so far
+    void load();
+
+    // Appends one replication to the state file and to the loaded state
+    void append(long replication, double cpuSeconds, const std::vector<LinkResult>& results);
+
+    long getNumReplications() const { return cpuSecondsPerReplication.size(); }
+    double getCpuSecondsUsed() const;
+    std::map<std::string, Estimate> meanEstimates() const;
+    std::map<std::string, Estimate> p99Estimates() const;
+
+    // True when every link meets the precision target, or the CPU budget is used up
+    bool targetReached() const;
+    bool budgetExhausted() const;
+    bool shouldStop() const { return targetReached() || budgetExhausted(); }
+};
+
+#endif
@@ -0,0 +1,122 @@
+#include "SharedMedium.h"
+#include "Node.h"
+#include <algorithm>
+#include <cmath>
+
+Define_Module(SharedMedium);
+
+SharedMedium::~SharedMedium(){
+    for (auto& port : receptions)
+        for (auto& reception : port)
+            delete reception.frame;
+}
+
+void SharedMedium::initialize(){
+    system = check_and_cast<GarbageCollectionSystem *>(getParentModule());
+
+    datarate = par("datarate");
+    baseLatency = par("baseLatency");
+    propSpeed = par("propSpeed");
+    frameBits = par("frameBytes").intValue() * 8;
+
+    for (int i = 0; i < gateSize("port"); i++)
+        attached.push_back(check_and_cast<Node *>(gate("port$o", i)->getPathEndGate()->getOwnerModule()));
+    receptions.resize(attached.size());
+}
+
+void SharedMedium::handleMessage(cMessage *msg){
+    if (msg->isSelfMessage())
+        deliver(msg);
+    else {
+        system->traceReceive(this, msg);
+        transmit(msg, msg->getArrivalGate()->getIndex());
+    }
+}
+
+// Same overlap rule as the host uses for the cans
+bool SharedMedium::inCoverage(Node *a, Node *b) const {
+    double range = a->par("range").doubleValue() + b->par("range").doubleValue();
+    return std::hypot(a->getX() - b->getX(), a->getY() - b->getY()) <= range;
+}
+
+void SharedMedium::transmit(cMessage *frame, int senderPort){
+    Node *sender = attached[senderPort];
+    simtime_t now = simTime();
+    simtime_t frameAirtime = getFrameAirtime();
+
+    framesSent++;
+    airtime += frameAirtime;
+    busyTime += std::max(SIMTIME_ZERO, now + frameAirtime - std::max(now, busyUntil));
+    busyUntil = std::max(busyUntil, now + frameAirtime);
+
+    frame->addPar("sender") = sender->getId();
+
+    for (int port = 0; port < (int)attached.size(); port++) {
+        Node *receiver = attached[port];
+        if (port == senderPort || !inCoverage(sender, receiver))
+            continue;
+
+        double distance = std::hypot(sender->getX() - receiver->getX(), sender->getY() - receiver->getY());
+        Reception reception;
+        reception.port = port;
+        reception.start = now + baseLatency + distance / propSpeed;
+        reception.end = reception.start + frameAirtime;
+        reception.frame = frame->dup();
+        reception.collided = false;
+
+        // Any overlap with a reception still in progress at this receiver destroys both
+        for (auto& other : receptions[port]) {
+            if (other.start < reception.end && reception.start < other.end) {
+                other.collided = true;
+                reception.collided = true;
+            }
+        }
+
+        if (sender == system->hostNode) {
+            GlobalDelays.fast_smartphone_to_others += (reception.end - now).dbl();
+        }
+        else if (receiver == system->hostNode) {
+            GlobalDelays.fast_others_to_smartphone += (reception.end - now).dbl();
+        }
+
+        cMessage *endEvent = new cMessage("receptionEnd");
+        endEvent->setContextPointer(reception.frame);
+        receptions[port].push_back(reception);
+        scheduleAt(reception.end, endEvent);
+    }
+
+    delete frame;
+}
+
+void SharedMedium::deliver(cMessage *endEvent){
+    cMessage *frame = static_cast<cMessage *>(endEvent->getContextPointer());
+    delete endEvent;
+
+    for (int port = 0; port < (int)receptions.size(); port++) {
+        for (auto it = receptions[port].begin(); it != receptions[port].end(); ++it) {
+            if (it->frame != frame) continue;
+
+            if (it->collided) {
+                collisions++;
+                delete frame;
+            }
+            else {
+                framesDelivered++;
+                system->traceSend(this, frame);
+                send(frame, "port$o", port);
+            }
+            receptions[port].erase(it);
+            return;
+        }
+    }
+}
+
+void SharedMedium::finish(){
+    recordScalar("framesSent", framesSent);
+    recordScalar("framesDelivered", framesDelivered);
+    recordScalar("collisions", collisions);
+    recordScalar("airtime", airtime, "s");
+    recordScalar("frameAirtime", getFrameAirtime(), "s");
+    if (simTime() > SIMTIME_ZERO)
+        recordScalar("busyFraction", busyTime / simTime());
+}
@@ -0,0 +1,62 @@
+#ifndef __SMARTGARBAGECOLLECTION_SHAREDMEDIUM_H_
+#define __SMARTGARBAGECOLLECTION_SHAREDMEDIUM_H_
+
+#include <list>
+#include <vector>
+#include <omnetpp.h>
+using namespace omnetpp;
+
+class Node;
+class GarbageCollectionSystem;
+
+/**
+ * One-to-many radio medium for the broadcast discovery mode. A frame sent into a port is delivered to
+ * every other attached node whose coverage overlaps the sender's. Frames that overlap in time at a
+ * receiver collide and are lost for that receiver.
+ */
+class SharedMedium : public cSimpleModule
+{
+  protected:
+    // An ongoing reception at one receiver, delivered when its last bit has arrived
+    struct Reception {
+        int port;
+        simtime_t start;
+        simtime_t end;
+        cMessage *frame;
+        bool collided;
+    };
+
+    GarbageCollectionSystem *system = nullptr;
+
+    double datarate;
+    simtime_t baseLatency;
+    double propSpeed;
+    long frameBits;
+
+    std::vector<Node *> attached;                 // Node at the other end of each port
+    std::vector<std::list<Reception>> receptions; // Per port, kept until their end event
+
+    // Statistics
+    long framesSent = 0;
+    long framesDelivered = 0;
+    long collisions = 0;
+    simtime_t airtime;       // Summed over transmissions
+    simtime_t busyTime;      // Time at least one transmission is on the air
+    simtime_t busyUntil;
+
+  protected:
+    virtual void initialize() override;
+    virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
+
+    void transmit(cMessage *frame, int senderPort);
+    void deliver(cMessage *endEvent);
+    bool inCoverage(Node *a, Node *b) const;
+
+  public:
+    virtual ~SharedMedium();
+
+    simtime_t getFrameAirtime() const { return frameBits / datarate; }
+};
+
+#endif
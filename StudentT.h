@@ -0,0 +1,19 @@
+#ifndef __SMARTGARBAGECOLLECTION_STUDENTT_H_
+#define __SMARTGARBAGECOLLECTION_STUDENTT_H_
+
+// Two sided 97.5% quantile of Student's t distribution, for 95% confidence intervals
+inline double studentT975(long degreesOfFreedom)
+{
+    static const double table[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+    if (degreesOfFreedom < 1) return table[0];
+    if (degreesOfFreedom <= 30) return table[degreesOfFreedom - 1];
+    if (degreesOfFreedom <= 60) return 2.000;
+    if (degreesOfFreedom <= 120) return 1.980;
+    return 1.960;
+}
+
+#endif
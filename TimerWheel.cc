@@ -0,0 +1,124 @@
+#include "TimerWheel.h"
+
+#include <algorithm>
+
+TimerWheel::TimerWheel(int slotBits, int numLevels) :
+    slotBits(slotBits), numSlots(1 << slotBits), numLevels(numLevels),
+    slots(numLevels << slotBits, nullptr), levelCount(numLevels, 0)
+{
+}
+
+void TimerWheel::schedule(WheelTimer *timer, int64_t expiryTick){
+    if (timer->scheduled && timer->level >= 0)
+        unlink(timer);
+    timer->expiryTick = expiryTick;
+    timer->scheduled = true;
+    insert(timer);
+}
+
+void TimerWheel::cancel(WheelTimer *timer){
+    if (timer->scheduled && timer->level >= 0)
+        unlink(timer);
+    timer->scheduled = false;
+    timer->level = -1;
+}
+
+// The level is the smallest whose range covers the distance to the expiry, past ticks expire on the next one
+void TimerWheel::insert(WheelTimer *timer){
+    int64_t expiry = std::max(timer->expiryTick, currentTick);
+    int64_t delta = expiry - currentTick;
+
+    int level = 0;
+    while (level < numLevels - 1 && delta >= ((int64_t)1 << (slotBits * (level + 1))))
+        level++;
+
+    // Beyond the top level, park in its farthest slot
+    int64_t range = (int64_t)1 << (slotBits * numLevels);
+    if (delta >= range)
+        expiry = currentTick + range - 1;
+
+    int slot = (int)((expiry >> (slotBits * level)) & (numSlots - 1));
+    WheelTimer *&head = slots[level * numSlots + slot];
+    timer->level = level;
+    timer->slot = slot;
+    timer->prev = nullptr;
+    timer->next = head;
+    if (head) head->prev = timer;
+    head = timer;
+    levelCount[level]++;
+}
+
+void TimerWheel::unlink(WheelTimer *timer){
+    if (timer->prev) timer->prev->next = timer->next;
+    else slots[timer->level * numSlots + timer->slot] = timer->next;
+    if (timer->next) timer->next->prev = timer->prev;
+    levelCount[timer->level]--;
+    timer->prev = timer->next = nullptr;
+    timer->level = -1;
+}
+
+WheelTimer *TimerWheel::detachSlot(int level, int slot){
+    WheelTimer *&head = slots[level * numSlots + slot];
+    WheelTimer *list = head;
+    head = nullptr;
+    for (WheelTimer *t = list; t; t = t->next) {
+        levelCount[level]--;
+        t->level = -1;
+    }
+    return list;
+}
+
+int64_t TimerWheel::nextTick() const {
+    long higher = 0;
+    for (int level = 1; level < numLevels; level++)
+        higher += levelCount[level];
+    if (levelCount[0] == 0 && higher == 0)
+        return -1;
+
+    // A level 0 timer is found within one rotation, a higher level one is cascaded at the next wrap
+    for (int64_t t = currentTick; ; t++) {
+        if (higher > 0 && (t & (numSlots - 1)) == 0)
+            return t;
+        if (slots[t & (numSlots - 1)])
+            return t;
+    }
+}
+
+void TimerWheel::advance(int64_t tick, std::vector<WheelTimer *>& expired){
+    for (; currentTick <= tick; currentTick++) {
+        // Cascade from the top, a level's slot comes down when all lower levels wrap
+        for (int level = numLevels - 1; level >= 1; level--) {
+            int64_t span = (int64_t)1 << (slotBits * level);
+            if ((currentTick & (span - 1)) != 0)
+                continue;
+            int slot = (int)((currentTick >> (slotBits * level)) & (numSlots - 1));
+            WheelTimer *list = detachSlot(level, slot);
+            while (list) {
+                WheelTimer *t = list;
+                list = list->next;
+                insert(t);
+                cascaded++;
+            }
+        }
+
+        WheelTimer *list = detachSlot(0, (int)(currentTick & (numSlots - 1)));
+        for (WheelTimer *t = list; t; ) {
+            WheelTimer *next = t->next;
+            t->prev = t->next = nullptr;
+            expired.push_back(t);
+            t = next;
+        }
+    }
+}
+
+void TimerWheel::skipTo(int64_t tick){
+    if (size() == 0)
+        currentTick = std::max(currentTick, tick);
+}
+
+long TimerWheel::size() const {
+    long total = 0;
+    for (long count : levelCount)
+        total += count;
+    return total;
+}
@@ -0,0 +1,75 @@
+#ifndef __SMARTGARBAGECOLLECTION_TIMERWHEEL_H_
+#define __SMARTGARBAGECOLLECTION_TIMERWHEEL_H_
+
+#include <cstdint>
+#include <vector>
+
+struct WheelTimer;
+
+// Implemented by the owners of wheel timers, called when a timer expires
+class WheelTimerClient
+{
+  public:
+    virtual ~WheelTimerClient() {}
+    virtual void wheelTimerFired(WheelTimer *timer) = 0;
+};
+
+// A timer is owned by its client and linked into one slot of the wheel while scheduled
+struct WheelTimer {
+    WheelTimerClient *client = nullptr;
+    void *context = nullptr;      // For the client to tell its timers apart
+    int64_t expiryTick = 0;
+    bool scheduled = false;
+
+    // Slot list links, level -1 while in the expired batch of the current tick
+    WheelTimer *prev = nullptr;
+    WheelTimer *next = nullptr;
+    int level = -1;
+    int slot = -1;
+};
+
+/**
+ * Hierarchical timing wheel over integer ticks. Level 0 has one slot per tick, every higher level covers
+ * numSlots slots of the level below, and its slot is cascaded down when level 0 wraps around to it.
+ * Scheduling and cancelling are O(1), timers expiring in the same tick are handed out as one batch.
+ * Timers past the top level's range wait in its farthest slot and are re-inserted when it cascades.
+ */
+class TimerWheel
+{
+  protected:
+    int slotBits;
+    int numSlots;
+    int numLevels;
+    std::vector<WheelTimer *> slots;   // Head of each slot list, level * numSlots + slot
+    std::vector<long> levelCount;      // Timers per level
+    int64_t currentTick = 0;           // Next tick to process
+
+    // Statistics
+    long cascaded = 0;
+
+  public:
+    TimerWheel(int slotBits, int numLevels);
+
+    void schedule(WheelTimer *timer, int64_t expiryTick);
+    void cancel(WheelTimer *timer);
+
+    // Earliest tick advance() has work at, a non-empty level 0 slot or a cascade, -1 when no timer is scheduled
+    int64_t nextTick() const;
+
+    // Processes every tick up to and including the given one, appends the expired timers. They stay scheduled
+    // at level -1 so the caller can skip the ones cancelled or rescheduled while it fires the batch
+    void advance(int64_t tick, std::vector<WheelTimer *>& expired);
+
+    // Moves an empty wheel forward without processing the ticks in between
+    void skipTo(int64_t tick);
+
+    long size() const;
+    long getCascaded() const { return cascaded; }
+
+  protected:
+    void insert(WheelTimer *timer);
+    void unlink(WheelTimer *timer);
+    WheelTimer *detachSlot(int level, int slot);
+};
+
+#endif
@@ -0,0 +1,112 @@
+#include "TraceWriter.h"
+
+#include <sstream>
+
+TraceWriter::TraceWriter(const std::string& fileName, size_t bufferBytes) : bufferBytes(bufferBytes)
+{
+    out.open(fileName);
+    buffer.reserve(bufferBytes + 512);
+    buffer += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+}
+
+TraceWriter::~TraceWriter()
+{
+    close();
+}
+
+void TraceWriter::processName(int pid, const std::string& name)
+{
+    std::ostringstream event;
+    event << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"args\":{\"name\":\"" << escape(name) << "\"}}";
+    append(event.str());
+}
+
+void TraceWriter::threadName(int pid, int tid, const std::string& name)
+{
+    std::ostringstream event;
+    event << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << tid << ",\"args\":{\"name\":\"" << escape(name) << "\"}}";
+    append(event.str());
+}
+
+void TraceWriter::slice(int pid, int tid, const std::string& name, const char *category, double tsUs, double durUs, long msgTreeId)
+{
+    std::ostringstream event;
+    event.precision(15);
+    event << "{\"name\":\"" << escape(name) << "\",\"cat\":\"" << category << "\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << tid
+          << ",\"ts\":" << tsUs << ",\"dur\":" << durUs;
+    if (msgTreeId >= 0)
+        event << ",\"args\":{\"treeId\":" << msgTreeId << "}";
+    event << "}";
+    append(event.str());
+}
+
+void TraceWriter::instant(int pid, int tid, const std::string& name, const char *category, double tsUs)
+{
+    std::ostringstream event;
+    event.precision(15);
+    event << "{\"name\":\"" << escape(name) << "\",\"cat\":\"" << category << "\",\"ph\":\"i\",\"s\":\"t\",\"pid\":" << pid << ",\"tid\":" << tid
+          << ",\"ts\":" << tsUs << "}";
+    append(event.str());
+}
+
+void TraceWriter::flowStart(int pid, int tid, long flowId, const std::string& name, double tsUs)
+{
+    std::ostringstream event;
+    event.precision(15);
+    event << "{\"name\":\"" << escape(name) << "\",\"cat\":\"flow\",\"ph\":\"s\",\"id\":" << flowId << ",\"pid\":" << pid << ",\"tid\":" << tid
+          << ",\"ts\":" << tsUs << "}";
+    append(event.str());
+}
+
+// Binding point "e" attaches the arrow to the slice enclosing the timestamp on the receiving track
+void TraceWriter::flowEnd(int pid, int tid, long flowId, const std::string& name, double tsUs)
+{
+    std::ostringstream event;
+    event.precision(15);
+    event << "{\"name\":\"" << escape(name) << "\",\"cat\":\"flow\",\"ph\":\"f\",\"bp\":\"e\",\"id\":" << flowId << ",\"pid\":" << pid << ",\"tid\":" << tid
+          << ",\"ts\":" << tsUs << "}";
+    append(event.str());
+}
+
+void TraceWriter::append(const std::string& event)
+{
+    if (!firstEvent)
+        buffer += ",\n";
+    buffer += event;
+    firstEvent = false;
+    numEvents++;
+
+    if (buffer.size() >= bufferBytes)
+        flush();
+}
+
+void TraceWriter::flush()
+{
+    if (out.is_open())
+        out.write(buffer.data(), buffer.size());
+    buffer.clear();
+}
+
+void TraceWriter::close()
+{
+    if (!out.is_open()) return;
+
+    buffer += "\n]}\n";
+    flush();
+    out.close();
+}
+
+std::string TraceWriter::escape(const std::string& text)
+{
+    std::string escaped;
+    escaped.reserve(text.size());
+    for (char c : text) {
+        switch (c) {
+            case '"': escaped += "\\\""; break;
+            case '\\': escaped += "\\\\"; break;
+            case '\n': escaped += "\\n"; break;
+            default: escaped += c;
+        }
+    }
+    return escaped;
+}
@@ -0,0 +1,49 @@
+#ifndef __SMARTGARBAGECOLLECTION_TRACEWRITER_H_
+#define __SMARTGARBAGECOLLECTION_TRACEWRITER_H_
+
+#include <fstream>
+#include <string>
+
+/**
+ * Streams Chrome Trace Event JSON (chrome://tracing, ui.perfetto.dev). Events are appended to an
+ * in-memory buffer which goes to the file whenever it exceeds bufferBytes, so large runs never
+ * hold the whole trace in memory. Timestamps are in microseconds.
+ */
+class TraceWriter
+{
+  protected:
+    std::ofstream out;
+    std::string buffer;
+    size_t bufferBytes;
+    bool firstEvent = true;
+    long numEvents = 0;
+
+  public:
+    TraceWriter(const std::string& fileName, size_t bufferBytes);
+    ~TraceWriter();
+
+    bool isOpen() const { return out.is_open(); }
+    long getNumEvents() const { return numEvents; }
+
+    // Track naming, one track (thread) per node
+    void processName(int pid, const std::string& name);
+    void threadName(int pid, int tid, const std::string& name);
+
+    // Complete event with a duration, and zero-duration instant on a track
+    void slice(int pid, int tid, const std::string& name, const char *category, double tsUs, double durUs, long msgTreeId = -1);
+    void instant(int pid, int tid, const std::string& name, const char *category, double tsUs);
+
+    // Flow arrow from a slice on one track to a slice on another, bound to the enclosing slices
+    void flowStart(int pid, int tid, long flowId, const std::string& name, double tsUs);
+    void flowEnd(int pid, int tid, long flowId, const std::string& name, double tsUs);
+
+    // Writes the closing bracket and the remaining buffer
+    void close();
+
+  protected:
+    void append(const std::string& event);
+    void flush();
+    static std::string escape(const std::string& text);
+};
+
+#endif
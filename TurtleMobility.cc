@@ -7,10 +7,24 @@
 
 
 #include "TurtleMobility.h"
+#include "GarbageCollectionSystem.h"
 
 // Create the module in the appropriate namespace
 Define_Module(Extended::TurtleMobility);
 
+// The base reads turtleScript in INITSTAGE_LOCAL, the system has built its route by then since it initializes first
+void Extended::TurtleMobility::initialize(int stage){
+    inet::TurtleMobility::initialize(stage);
+
+    if (stage == inet::INITSTAGE_LOCAL) {
+        auto *system = dynamic_cast<GarbageCollectionSystem *>(getParentModule()->getParentModule());
+        if (system && system->getRoadRoute()) {
+            turtleScript = system->getRoadRoute()->getElementById("1");
+            nextStatement = turtleScript->getFirstChild();
+        }
+    }
+}
+
 // Assumes a single stretch to traverse, but will handle an arbitrary movement,  but we are interested in essentially traversing a single street at a time
 void Extended::TurtleMobility::setLeg(inet::cXMLElement *leg){
     // Set the turtleScript to the new leg
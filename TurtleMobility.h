@@ -14,6 +14,10 @@ namespace Extended{
 class TurtleMobility : public inet::TurtleMobility // inherit from base Turtle
 {
 
+protected:
+    // Starts on the first generated leg when the system loaded a road network
+    virtual void initialize(int stage) override;
+
 public:
     // set a leg to traverse
     void setLeg(inet::cXMLElement * leg);
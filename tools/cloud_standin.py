@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+"""Minimal stand-in for the cloud collect handler, for CloudNode's serviceAddress.
+
+Protocol, one request per line over TCP:
+    COLLECT <can> <request id>   ->   OK <request id>
+Anything else is answered with "ERROR <reason>", which the simulation counts as a service failure.
+Put the real handler in handle_collect() to measure it inside the collection protocol.
+"""
+
+import argparse
+import socketserver
+import time
+
+
+def handle_collect(can, request_id, delay):
+    if delay > 0:
+        time.sleep(delay)
+    return "OK " + request_id
+
+
+class CollectHandler(socketserver.StreamRequestHandler):
+    def handle(self):
+        for raw in self.rfile:
+            fields = raw.decode("ascii", "replace").split()
+            if len(fields) == 3 and fields[0] == "COLLECT":
+                reply = handle_collect(fields[1], fields[2], self.server.delay)
+            else:
+                reply = "ERROR bad request"
+            self.wfile.write((reply + "\n").encode("ascii"))
+            self.wfile.flush()
+
+
+class Server(socketserver.ThreadingTCPServer):
+    allow_reuse_address = True
+    daemon_threads = True
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=9750)
+    parser.add_argument("--delay-ms", type=float, default=0, help="processing time added to every collect")
+    args = parser.parse_args()
+
+    with Server((args.host, args.port), CollectHandler) as server:
+        server.delay = args.delay_ms / 1000
+        print("cloud stand-in listening on %s:%d" % (args.host, args.port), flush=True)
+        try:
+            server.serve_forever()
+        except KeyboardInterrupt:
+            pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+"""Paired comparison of FAST, SLOW and EMPTY from the simulated runs of the Paired* configs.
+
+PairedFast, PairedSlow and PairedEmpty extend CommonRandomNumbers, so repetition k of each config
+draws the same jitter on the hops the strategies share. This script pairs the runs by repetition,
+takes the difference of a host metric per pair, and reports the mean difference with a 95% Student-t
+confidence interval. Pairing removes the variance the strategies share, so the intervals are
+tighter than those of independent runs with as many repetitions.
+
+The metrics are the host's per run results: a field of a recorded statistic such as
+visitTotal:mean, or a plain scalar such as lastCanDeparture.
+
+Run the three configs first, then from the project root:
+    ./SmartGarbageCollection -u Cmdenv -c PairedFast
+    ./SmartGarbageCollection -u Cmdenv -c PairedSlow
+    ./SmartGarbageCollection -u Cmdenv -c PairedEmpty
+    tools/paired_compare.py --results results
+"""
+
+import argparse
+import glob
+import math
+import os
+import sys
+
+CONFIGS = [("Fast", "PairedFast"), ("Slow", "PairedSlow"), ("Empty", "PairedEmpty")]
+
+# Two sided 97.5% quantiles of Student's t, the table of StudentT.h
+T975 = [12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042]
+
+
+def student_t975(dof):
+    if dof < 1:
+        return T975[0]
+    if dof <= 30:
+        return T975[dof - 1]
+    if dof <= 60:
+        return 2.000
+    if dof <= 120:
+        return 1.980
+    return 1.960
+
+
+def read_run(sca_file, module):
+    """Returns (config, repetition, values), values by "name" for scalars and "name:field" for statistic fields."""
+    config, repetition, values = None, None, {}
+    statistic = None
+    with open(sca_file) as sca:
+        for line in sca:
+            fields = line.split()
+            if not fields:
+                continue
+            if fields[0] == "attr" and len(fields) >= 3:
+                if fields[1] == "configname":
+                    config = fields[2]
+                elif fields[1] == "repetition":
+                    repetition = int(fields[2])
+            elif fields[0] == "scalar" and len(fields) >= 4:
+                statistic = None
+                if fields[1].endswith(module):
+                    values[fields[2]] = float(fields[3])
+            elif fields[0] == "statistic" and len(fields) >= 3:
+                statistic = fields[2] if fields[1].endswith(module) else None
+            elif fields[0] == "field" and statistic and len(fields) >= 3:
+                values[statistic + ":" + fields[1]] = float(fields[2])
+            elif fields[0] not in ("field", "attr", "bin"):
+                statistic = None
+    return config, repetition, values
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--results", default="results", help="directory with the .sca files of the Paired* runs")
+    parser.add_argument("--module", default="host[0]", help="module whose results are compared")
+    parser.add_argument("--metric", action="append",
+                        help="scalar or statistic:field to compare, repeatable (default visitTotal:mean and lastCanDeparture)")
+    args = parser.parse_args()
+    metrics = args.metric or ["visitTotal:mean", "lastCanDeparture"]
+
+    # runs[strategy][repetition] = values
+    runs = {strategy: {} for strategy, _ in CONFIGS}
+    strategy_of = {config: strategy for strategy, config in CONFIGS}
+    for sca_file in glob.glob(os.path.join(args.results, "*.sca")):
+        config, repetition, values = read_run(sca_file, args.module)
+        if config in strategy_of and repetition is not None:
+            runs[strategy_of[config]][repetition] = values
+
+    if not all(runs.values()):
+        missing = [config for strategy, config in CONFIGS if not runs[strategy]]
+        sys.exit("No results of %s in %s" % (", ".join(missing), args.results))
+
+    pairs = [("Fast", "Slow"), ("Fast", "Empty"), ("Slow", "Empty")]
+    for metric in metrics:
+        for a, b in pairs:
+            differences = [runs[a][k][metric] - runs[b][k][metric]
+                           for k in sorted(set(runs[a]) & set(runs[b]))
+                           if metric in runs[a][k] and metric in runs[b][k]]
+            n = len(differences)
+            if n < 2:
+                print("%s %s-%s: %d pairs, too few for an interval" % (metric, a, b, n))
+                continue
+            mean = sum(differences) / n
+            stddev = math.sqrt(sum((d - mean) ** 2 for d in differences) / (n - 1))
+            half_width = student_t975(n - 1) * stddev / math.sqrt(n)
+            print("%s %s-%s: %.6g +- %.3g (95%% CI, %d pairs)" % (metric, a, b, mean, half_width, n))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+"""Runs the scenarios of tools/scenario_gen.py under Cmdenv and reports how the model scales.
+
+Per run it records the events, the events per wall second, the peak resident set size of the
+simulation process, the network setup time, and the simulated seconds per wall second. The setup
+time is the setupWallTime scalar of GarbageCollectionSystem, measured from the construction of
+the network to its first event. Events per second and simulated seconds per wall second cover
+the part after the setup.
+
+Results go to a CSV. The summary names the first size of each strategy that runs slower than
+real time, or whose events per second drop below half those of the smallest size.
+
+Run from the project root:
+    tools/scaling_bench.py --manifest scenarios/manifest.json --inet ../inet4.5/src
+"""
+
+import argparse
+import csv
+import glob
+import json
+import os
+import re
+import subprocess
+import sys
+import threading
+import time
+
+END_RE = re.compile(r"at t=([0-9.eE+-]+)s, event #(\d+)")
+
+
+def read_scalar(sca_file, name):
+    if not os.path.exists(sca_file):
+        return None
+    with open(sca_file) as sca:
+        for line in sca:
+            fields = line.split()
+            if len(fields) >= 4 and fields[0] == "scalar" and fields[2] == name:
+                return float(fields[3])
+    return None
+
+
+def run(args, manifest, entry):
+    result_dir = os.path.join(args.results, entry["config"])
+    os.makedirs(result_dir, exist_ok=True)
+    for old in glob.glob(os.path.join(result_dir, "*")):
+        os.remove(old)
+
+    ned_path = os.pathsep.join([".", manifest["nedPath"]] + ([args.inet] if args.inet else []))
+    cmd = [args.executable, "-u", "Cmdenv", "-f", manifest["ini"], "-c", entry["config"], "-r", "0",
+           "-n", ned_path, "--result-dir=" + result_dir, "--cmdenv-express-mode=true",
+           "--cmdenv-performance-display=false", "--cmdenv-redirect-output=false",
+           "--record-eventlog=false", "--**.vector-recording=false"]
+    if args.sim_time:
+        cmd.append("--sim-time-limit=" + args.sim_time)
+
+    start = time.monotonic()
+    proc = subprocess.Popen(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+    killer = threading.Timer(args.timeout, proc.kill)
+    killer.start()
+    output = proc.stdout.read()
+    # Reaped here instead of by Popen, to get the resource usage of this child only
+    _, status, usage = os.wait4(proc.pid, 0)
+    wall = time.monotonic() - start
+    killer.cancel()
+    exit_code = os.waitstatus_to_exitcode(status)
+
+    row = dict(entry)
+    row["exitCode"] = exit_code
+    row["wall"] = wall
+
+    match = None
+    for match in END_RE.finditer(output):
+        pass
+    sim_time = float(match.group(1)) if match else None
+    events = int(match.group(2)) if match else None
+
+    sca = glob.glob(os.path.join(result_dir, "*.sca"))
+    setup = read_scalar(sca[0], "setupWallTime") if sca else None
+    row["simTime"] = sim_time
+    row["events"] = events
+    row["setup"] = setup
+    run_wall = wall - (setup or 0)
+    row["eventsPerSec"] = events / run_wall if events is not None and run_wall > 0 else None
+    row["simSecPerWallSec"] = sim_time / run_wall if sim_time is not None and run_wall > 0 else None
+    row["peakRssMB"] = peak_rss_mb(usage)
+
+    if exit_code != 0:
+        tail = "\n".join(output.splitlines()[-5:])
+        print("  %s failed (%s):\n%s" % (entry["config"], exit_code, tail), file=sys.stderr)
+    return row
+
+
+# ru_maxrss is KiB on Linux and bytes on macOS
+def peak_rss_mb(usage):
+    scale = 1 if sys.platform == "darwin" else 1024
+    return usage.ru_maxrss * scale / (1024 * 1024)
+
+
+def summarize(rows):
+    for strategy in sorted({row["strategy"] for row in rows}):
+        runs = sorted((r for r in rows if r["strategy"] == strategy and r["eventsPerSec"]),
+                      key=lambda r: (r["hosts"] * r["cans"], r["hosts"], r["cans"]))
+        if not runs:
+            continue
+        baseline = runs[0]["eventsPerSec"]
+        knee = next((r for r in runs if (r["simSecPerWallSec"] or 0) < 1 or r["eventsPerSec"] < baseline / 2), None)
+        if knee:
+            print("%s: stops scaling at %d hosts, %d cans (%.0f events/s, %.2f sim s per wall s, %.0f MB)"
+                  % (strategy, knee["hosts"], knee["cans"], knee["eventsPerSec"], knee["simSecPerWallSec"],
+                     knee["peakRssMB"] or 0))
+        else:
+            print("%s: scales over all sizes" % strategy)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--manifest", default="scenarios/manifest.json")
+    parser.add_argument("--executable", default="./SmartGarbageCollection")
+    parser.add_argument("--inet", default=os.environ.get("INET_NED", ""), help="INET's NED folder, default $INET_NED")
+    parser.add_argument("--results", default="results/scaling")
+    parser.add_argument("--csv", default="results/scaling.csv")
+    parser.add_argument("--sim-time", default="", help="overrides the scenarios' sim-time-limit")
+    parser.add_argument("--timeout", type=float, default=3600, help="wall seconds per run")
+    parser.add_argument("--only", default="", help="regex on the config names")
+    args = parser.parse_args()
+
+    with open(args.manifest) as f:
+        manifest = json.load(f)
+
+    rows = []
+    for entry in manifest["runs"]:
+        if args.only and not re.search(args.only, entry["config"]):
+            continue
+        print("running %s" % entry["config"], flush=True)
+        rows.append(run(args, manifest, entry))
+
+    os.makedirs(os.path.dirname(args.csv) or ".", exist_ok=True)
+    fields = ["config", "strategy", "hosts", "cans", "exitCode", "wall", "setup", "simTime", "events",
+              "eventsPerSec", "simSecPerWallSec", "peakRssMB"]
+    with open(args.csv, "w", newline="") as out:
+        writer = csv.DictWriter(out, fieldnames=fields)
+        writer.writeheader()
+        writer.writerows(rows)
+    print("results in %s" % args.csv)
+    summarize(rows)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+"""Generates scaling scenarios derived from the GarbageCollectionSystem network.
+
+Every size is a host count and a can count. Each size gets a NED network extending
+GarbageCollectionSystem, a synthetic grid road network, a can layout, and one ini config per
+strategy (FAST, SLOW, EMPTY) extending the base configs of omnetpp.ini.
+
+The protocol drives a single truck, so the other hosts are the operator core's virtual hosts
+(CellularCore.numVirtualHosts), the load of the rest of the fleet on the cloud path. The cans are
+a CanField over the layout by default, or CanNode modules with --can-model modules.
+
+Only the two protocol cans take part in the route, the host never queries the others. In both can
+models the other cans cost setup time and memory but no events, so across can counts the events per
+second of scaling_bench.py measure the setup and the route, not can traffic. --report-interval gives
+the field's cans a run-time load, every can sends its fill level to the cloud once per interval.
+
+The two protocol cans are the first two rows of every layout and sit where the default district has
+them, so the host's route is the same at every size.
+
+Run from the project root, then run tools/scaling_bench.py on the manifest:
+    tools/scenario_gen.py --out scenarios
+"""
+
+import argparse
+import json
+import math
+import os
+import random
+
+# The protocol cans of cans.csv, kept at every size
+PROTOCOL_CANS = [("can-1", 500.0, 150.0), ("can-2", 573.885, 794.65)]
+
+STRATEGIES = [("Fast", "GarbageInTheCansAndFast"), ("Slow", "GarbageInTheCansAndSlow"), ("Empty", "NoGarbageInTheCans")]
+
+
+def int_list(text):
+    return [int(v) for v in text.split(",") if v]
+
+
+def grid_side(cans, cans_per_block):
+    # At least the default district, 3450m x 1250m with the default spacing
+    return max(18, int(math.ceil(math.sqrt(cans / cans_per_block))) + 1)
+
+
+def write_roads(path, side, spacing, speed):
+    with open(path, "w") as out:
+        out.write("# Synthetic %dx%d grid, %gm blocks\n" % (side, side, spacing))
+        for row in range(side):
+            for col in range(side):
+                out.write("node %d %g %g\n" % (row * side + col, col * spacing, row * spacing))
+        for row in range(side):
+            for col in range(side):
+                node = row * side + col
+                if col + 1 < side:
+                    out.write("edge %d %d %g\n" % (node, node + 1, speed))
+                if row + 1 < side:
+                    out.write("edge %d %d %g\n" % (node, node + side, speed))
+
+
+# Cans at random points along the grid's streets, a few meters off the road
+def write_cans(path, cans, side, spacing, rng):
+    extent = (side - 1) * spacing
+    with open(path, "w") as out:
+        out.write("id,x,y\n")
+        for name, x, y in PROTOCOL_CANS:
+            out.write("%s,%g,%g\n" % (name, x, y))
+        for i in range(max(0, cans - len(PROTOCOL_CANS))):
+            along = rng.uniform(0, extent)
+            street = rng.randrange(side) * spacing + rng.uniform(-8, 8)
+            x, y = (along, street) if rng.random() < 0.5 else (street, along)
+            out.write("can-%d,%.1f,%.1f\n" % (i + 3, x, y))
+
+
+def network_name(hosts, cans):
+    return "Scale_h%d_c%d" % (hosts, cans)
+
+
+def write_ned(out, name, hosts, cans, can_model, report_interval):
+    out.write("network %s extends GarbageCollectionSystem\n{\n    parameters:\n" % name)
+    out.write("        useCellularCore = true;\n")
+    out.write("        core.numVirtualHosts = %d;\n" % (hosts - 1))
+    if can_model == "field":
+        out.write("        useCanField = true;\n")
+        if report_interval:
+            out.write("        field.reportInterval = %s;\n" % report_interval)
+    else:
+        out.write("        numExtraCans = %d;\n" % max(0, cans - len(PROTOCOL_CANS)))
+    out.write("}\n\n")
+
+
+def write_configs(out, name, files, sim_time):
+    for suffix, base in STRATEGIES:
+        out.write("[Config %s_%s]\n" % (name, suffix))
+        out.write("extends = %s\n" % base)
+        out.write("network = %s\n" % name)
+        out.write("sim-time-limit = %s\n" % sim_time)
+        out.write("*.roadNetworkFile = \"%s\"\n" % files["roads"])
+        out.write("*.canLayoutFile = \"%s\"\n" % files["cans"])
+        out.write("*.canSiteId = \"can-1\"\n")
+        out.write("*.anotherCanSiteId = \"can-2\"\n")
+        out.write("*.setupBenchmark = true\n")
+        out.write("*.setupBenchmarkEndsRun = false\n\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--out", default="scenarios", help="output directory, relative to the project root")
+    parser.add_argument("--hosts", type=int_list, default=[1, 10, 100, 1000])
+    parser.add_argument("--cans", type=int_list, default=[10, 100, 1000, 10000, 100000])
+    parser.add_argument("--can-model", choices=["field", "modules"], default="field")
+    parser.add_argument("--report-interval", default="", help="fill report period of every field can, e.g. 60s, empty for none")
+    parser.add_argument("--spacing", type=float, default=200, help="grid block size in meters")
+    parser.add_argument("--speed", type=float, default=370, help="speed of every street, the drawn roads' value")
+    parser.add_argument("--cans-per-block", type=float, default=4)
+    parser.add_argument("--sim-time", default="300s")
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    os.makedirs(args.out, exist_ok=True)
+    rng = random.Random(args.seed)
+    manifest = {"ini": os.path.join(args.out, "scenarios.ini"), "nedPath": args.out, "runs": []}
+
+    with open(os.path.join(args.out, "scenarios.ned"), "w") as ned, open(manifest["ini"], "w") as ini:
+        ned.write("// Generated by tools/scenario_gen.py\n\n")
+        ini.write("# Generated by tools/scenario_gen.py\ninclude %s\n\n" % os.path.relpath("omnetpp.ini", args.out))
+
+        # One road network and layout per can count, shared by the host counts
+        layouts = {}
+        for cans in args.cans:
+            side = grid_side(cans, args.cans_per_block)
+            files = {"roads": os.path.join(args.out, "roads-c%d.txt" % cans),
+                     "cans": os.path.join(args.out, "cans-c%d.csv" % cans)}
+            write_roads(files["roads"], side, args.spacing, args.speed)
+            write_cans(files["cans"], cans, side, args.spacing, rng)
+            layouts[cans] = files
+
+        for hosts in args.hosts:
+            for cans in args.cans:
+                name = network_name(hosts, cans)
+                write_ned(ned, name, hosts, cans, args.can_model, args.report_interval)
+                write_configs(ini, name, layouts[cans], args.sim_time)
+                for suffix, _ in STRATEGIES:
+                    manifest["runs"].append({"config": "%s_%s" % (name, suffix), "strategy": suffix,
+                                             "hosts": hosts, "cans": cans})
+
+    with open(os.path.join(args.out, "manifest.json"), "w") as out:
+        json.dump(manifest, out, indent=2)
+    print("%d configs in %s" % (len(manifest["runs"]), manifest["ini"]))
+
+
+if __name__ == "__main__":
+    main()